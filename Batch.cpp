@@ -0,0 +1,165 @@
+#include "Batch.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <istream>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+
+BatchSolver::BatchSolver(Order const order, unsigned const threads, std::chrono::milliseconds const budget,
+                         int const count)
+    : m_order{order}
+    , m_threads{std::max(1u, threads)}
+    , m_budget{budget}
+    , m_count{std::max(0, count)} {
+}
+
+bool BatchSolver::is_puzzle(std::string_view const line) noexcept {
+    return !line.empty() && line.front() != '#';
+}
+
+std::pair<std::string_view, std::string_view> BatchSolver::split(std::string_view const line) noexcept {
+    auto const space = line.rfind(' ');
+    if(space == std::string_view::npos) {
+        return { std::string_view{}, line };
+    }
+    return { line.substr(0, space), line.substr(space + 1) };
+}
+
+BatchSolver::Result BatchSolver::solve(std::string_view const line, std::size_t const line_number,
+                                       std::chrono::milliseconds const budget, int const count) {
+    Result result;
+    auto const [ name, puzzle ] = split(line);
+    result.name = name.empty() ? "line_" + std::to_string(line_number) : std::string(name);
+
+    auto const start = std::chrono::steady_clock::now();
+    auto const deadline = budget.count() > 0 ? start + budget : Grid::steady_clock_tp::max();
+    try {
+        Grid g{puzzle};
+        g.set_threads(1);
+        g.set_trace(false);
+
+        if(count > 0) {
+            int const limit = std::max(2, count);
+            Grid::SolutionCount const n = g.count_solutions(limit, deadline);
+
+            result.solutions = n.solutions;
+            result.limit = limit;
+            result.status = n.solutions > 1 ? "multiple"
+                : !n.exhausted ? "unknown"
+                : n.solutions == 1 ? "unique" : "none";
+            result.board = n.witnesses.empty() ? g.board() : n.witnesses.front();
+            if(n.witnesses.size() > 1) {
+                result.second = n.witnesses[1];
+            }
+            result.stats = g.stats();
+            auto const finish = std::chrono::steady_clock::now();
+            result.microseconds = std::chrono::duration_cast<std::chrono::microseconds>(finish - start).count();
+            return result;
+        }
+
+        Grid::SitRep sitrep = Grid::SitRep::KEEP_GOING;
+        while(sitrep == Grid::SitRep::KEEP_GOING) {
+            sitrep = std::chrono::steady_clock::now() < deadline
+                ? g.solve(false, true, deadline) : Grid::SitRep::CANNOT_PROCEED;
+        }
+        if(sitrep == Grid::SitRep::CANNOT_PROCEED && budget.count() > 0) {
+            sitrep = g.search(deadline, false);
+        }
+
+        switch(sitrep) {
+            case Grid::SitRep::SOLUTION_FOUND:      result.status = "solved";        break;
+            case Grid::SitRep::CONTRADICTION_FOUND: result.status = "contradiction"; break;
+            default:                                result.status = "stuck";         break;
+        }
+        result.board = g.board();
+        result.known = g.knownElements();
+        result.cells = static_cast<int>(result.board.size());
+        result.stats = g.stats();
+
+    } catch(std::exception const& e) {
+        result.status = "invalid";
+        result.board = e.what();
+    }
+    auto const finish = std::chrono::steady_clock::now();
+    result.microseconds = std::chrono::duration_cast<std::chrono::microseconds>(finish - start).count();
+
+    return result;
+}
+
+//Puzzles are independent and arrive as a stream, so every worker simply
+//pulls the next line from the shared reader when it is free. Long puzzles
+//cannot hold up the others, which is all stealing from per worker queues
+//would buy here.
+std::size_t BatchSolver::run(std::istream& in, std::ostream& out, Grid::Stats* const stats) const {
+    std::mutex in_mutex;
+    std::size_t line_number = 0;
+    std::size_t puzzles = 0;
+
+    std::mutex out_mutex;
+    std::size_t next_to_write = 0;
+    std::map<std::size_t, std::string> pending;
+
+    ThreadPool::shared().run(m_threads, [&](unsigned) {
+        std::string line;
+        for(;;) {
+            std::size_t sequence = 0;
+            std::size_t number = 0;
+            {
+                std::lock_guard lock{in_mutex};
+                do {
+                    if(!std::getline(in, line)) {
+                        return;
+                    }
+                    line_number++;
+                    if(!line.empty() && line.back() == '\r') {
+                        line.pop_back();
+                    }
+                } while(!is_puzzle(line));
+
+                sequence = puzzles++;
+                number = line_number;
+            }
+
+            Result const result = solve(line, number, m_budget, m_count);
+            std::ostringstream os;
+            os << result << '\n';
+
+            std::lock_guard lock{out_mutex};
+            if(stats) {
+                *stats += result.stats;
+            }
+            if(m_order == Order::COMPLETION) {
+                out << os.str();
+                continue;
+            }
+            //In input order a result waits until all earlier ones are out.
+            pending.emplace(sequence, os.str());
+            for(auto i = pending.begin(); i != pending.end() && i->first == next_to_write; i = pending.erase(i)) {
+                out << i->second;
+                next_to_write++;
+            }
+        }
+    });
+
+    out.flush();
+    return puzzles;
+}
+
+std::ostream& operator<<(std::ostream& os, BatchSolver::Result const& result) {
+    os << result.name << ' ' << result.status << ' ';
+    if(result.limit > 0) {
+        os << result.solutions << '/' << result.limit;
+    } else {
+        os << result.known << '/' << result.cells;
+    }
+    os << ' ' << result.microseconds << ' ' << result.board;
+    if(!result.second.empty()) {
+        os << ' ' << result.second;
+    }
+    return os;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "Grid.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <iosfwd>
+#include <string>
+#include <string_view>
+#include <utility>
+
+//Solves a corpus of puzzles on all cores. The corpus holds one puzzle per line
+//in Grid's compact format, optionally preceded by a name and a space:
+//
+//    nikoli_10 36x20:k4k2...
+//
+//Blank lines and lines starting with '#' are skipped. Each puzzle yields one
+//line of output:
+//
+//    name status known/cells microseconds board
+//
+//where status is solved, contradiction, stuck or invalid and board holds the
+//cells row by row: '#' black, '.' white or numbered, '?' unknown. For an
+//invalid puzzle the parse error takes the place of the board.
+//
+//When counting solutions up to a limit the line is instead
+//
+//    name status solutions/limit microseconds board [board]
+//
+//where status is unique, multiple, none, unknown (out of time) or invalid,
+//and the boards are the first two solutions found.
+class BatchSolver {
+public:
+    enum struct Order {
+        INPUT,
+        COMPLETION,
+    };
+
+    struct Result {
+        std::string name;
+        std::string_view status;
+        int known = 0;
+        int cells = 0;
+        long long microseconds = 0;
+        std::string board;
+        Grid::Stats stats;
+
+        //Only set when counting.
+        int solutions = 0;
+        int limit = 0;
+        std::string second;
+    };
+
+    //A puzzle gets up to `budget` for the rules and then Grid::search() on
+    //what they leave open; a zero budget lets the rules run to the end and
+    //skips the search. A nonzero `count` counts the solutions of every puzzle
+    //up to that limit instead, within the budget if there is one. The limit is
+    //at least 2: only a search past the first solution can tell that a puzzle
+    //is unique.
+    BatchSolver(Order order, unsigned threads, std::chrono::milliseconds budget, int count = 0);
+
+    //False for the blank and comment lines of a corpus.
+    [[nodiscard]] static bool is_puzzle(std::string_view line) noexcept;
+
+    //Splits a corpus line into its name, empty if it has none, and the puzzle.
+    [[nodiscard]] static std::pair<std::string_view, std::string_view> split(std::string_view line) noexcept;
+
+    //Parses and solves one corpus line, single threaded. Unnamed puzzles are
+    //named after their line number.
+    [[nodiscard]] static Result solve(std::string_view line, std::size_t line_number,
+                                      std::chrono::milliseconds budget, int count = 0);
+
+    //Streams the corpus from `in` and writes a result line per puzzle to `out`,
+    //either in input order or as puzzles finish. Returns the number of puzzles
+    //and, if asked, adds up the Grid::Stats of all of them in `stats`.
+    std::size_t run(std::istream& in, std::ostream& out, Grid::Stats* stats = nullptr) const;
+
+private:
+    Order m_order;
+    unsigned m_threads;
+    std::chrono::milliseconds m_budget;
+    int m_count;
+};
+
+std::ostream& operator<<(std::ostream& os, BatchSolver::Result const& result);
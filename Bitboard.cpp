@@ -0,0 +1,135 @@
+#include "Bitboard.hpp"
+
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+Bitboard::Bitboard(int const width, int const height)
+    : m_width{width}
+    , m_height{height}
+    , m_words{width / 64 + 1}
+    , m_bits(static_cast<std::size_t>(height) * m_words + 1, 0) {
+}
+
+void Bitboard::set(int const x, int const y) noexcept {
+    row(y)[x / 64] |= std::uint64_t{1} << (x % 64);
+}
+
+void Bitboard::reset(int const x, int const y) noexcept {
+    row(y)[x / 64] &= ~(std::uint64_t{1} << (x % 64));
+}
+
+bool Bitboard::test(int const x, int const y) const noexcept {
+    return (row(y)[x / 64] >> (x % 64)) & 1;
+}
+
+//The kernels walk the board as one flat run of words: word j and word j + m
+//(m words per row) are the same columns of two consecutive rows. The column to
+//the right of bit 63 is bit 0 of word j + 1. At the end of a row that word
+//belongs to the next row, but bit 63 of the last word is off the board, so
+//the window it starts can never match.
+namespace {
+
+    //Bit x of the result is bit x + 1 of the board.
+    inline std::uint64_t right(std::uint64_t const* const p) noexcept {
+        return (p[0] >> 1) | (p[1] << 63);
+    }
+
+#if defined(__AVX2__)
+    inline __m256i load(std::uint64_t const* const p) noexcept {
+        return _mm256_loadu_si256(reinterpret_cast<__m256i const*>(p));
+    }
+
+    inline __m256i right4(std::uint64_t const* const p) noexcept {
+        return _mm256_or_si256(_mm256_srli_epi64(load(p), 1), _mm256_slli_epi64(load(p + 1), 63));
+    }
+#endif
+
+}//end of namespace.
+
+bool any_pool(Bitboard const& black) {
+    int const m = black.words_per_row();
+    int const n = (black.height() - 1) * m;
+    std::uint64_t const* const b = black.row(0);
+    int j = 0;
+
+#if defined(__AVX2__)
+    for(; j + 4 <= n; j += 4) {
+        __m256i const pools = _mm256_and_si256(
+            _mm256_and_si256(load(b + j), right4(b + j)),
+            _mm256_and_si256(load(b + j + m), right4(b + j + m)));
+
+        if(!_mm256_testz_si256(pools, pools)) {
+            return true;
+        }
+    }
+#endif
+    for(; j < n; j++) {
+        if(b[j] & right(b + j) & b[j + m] & right(b + j + m)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+//Every cell of a wanted window is black or unknown, and the unknowns are
+//counted per window with a bit-sliced adder: ones and twos are the low bits
+//of the count, which is 1 for three_black and 2 for two_black.
+void pool_threats(Bitboard const& black, Bitboard const& unknown,
+                  Bitboard& three_black, Bitboard& two_black) {
+    int const m = black.words_per_row();
+    int const n = (black.height() - 1) * m;
+    std::uint64_t const* const b = black.row(0);
+    std::uint64_t const* const u = unknown.row(0);
+    std::uint64_t* const three = three_black.row(0);
+    std::uint64_t* const two = two_black.row(0);
+    int j = 0;
+
+#if defined(__AVX2__)
+    for(; j + 4 <= n; j += 4) {
+        __m256i const u0 = load(u + j);
+        __m256i const u0r = right4(u + j);
+        __m256i const u1 = load(u + j + m);
+        __m256i const u1r = right4(u + j + m);
+
+        __m256i const full = _mm256_and_si256(
+            _mm256_and_si256(_mm256_or_si256(load(b + j), u0), _mm256_or_si256(right4(b + j), u0r)),
+            _mm256_and_si256(_mm256_or_si256(load(b + j + m), u1), _mm256_or_si256(right4(b + j + m), u1r)));
+
+        __m256i const s1 = _mm256_xor_si256(u0, u0r);
+        __m256i const s2 = _mm256_xor_si256(u1, u1r);
+        __m256i const ones = _mm256_xor_si256(s1, s2);
+        __m256i const twos = _mm256_xor_si256(
+            _mm256_xor_si256(_mm256_and_si256(u0, u0r), _mm256_and_si256(u1, u1r)),
+            _mm256_and_si256(s1, s2));
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(three + j),
+            _mm256_and_si256(full, _mm256_andnot_si256(twos, ones)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(two + j),
+            _mm256_and_si256(full, _mm256_andnot_si256(ones, twos)));
+    }
+#endif
+    for(; j < n; j++) {
+        std::uint64_t const u0 = u[j];
+        std::uint64_t const u0r = right(u + j);
+        std::uint64_t const u1 = u[j + m];
+        std::uint64_t const u1r = right(u + j + m);
+
+        std::uint64_t const full = (b[j] | u0) & (right(b + j) | u0r)
+                                 & (b[j + m] | u1) & (right(b + j + m) | u1r);
+
+        std::uint64_t const s1 = u0 ^ u0r;
+        std::uint64_t const s2 = u1 ^ u1r;
+        std::uint64_t const ones = s1 ^ s2;
+        std::uint64_t const twos = (u0 & u0r) ^ (u1 & u1r) ^ (s1 & s2);
+
+        three[j] = full & ones & ~twos;
+        two[j] = full & twos & ~ones;
+    }
+
+    //The last row starts no window.
+    std::fill(three + n, three + n + m, 0);
+    std::fill(two + n, two + n + m, 0);
+}
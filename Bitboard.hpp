@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+//One bit per cell, stored a row at a time: row y is words_per_row() words
+//starting at row(y), and cell x is bit x % 64 of word x / 64. Every row keeps
+//at least one spare high bit and the board one spare word at the end, so a
+//kernel may read the x + 1 neighbor of the last column, or the word after the
+//last one, and find zero.
+class Bitboard {
+public:
+    Bitboard() = default;
+    Bitboard(int width, int height);
+
+    void set(int x, int y) noexcept;
+    void reset(int x, int y) noexcept;
+    [[nodiscard]] bool test(int x, int y) const noexcept;
+
+    [[nodiscard]] int width() const noexcept { return m_width; }
+    [[nodiscard]] int height() const noexcept { return m_height; }
+    [[nodiscard]] int words_per_row() const noexcept { return m_words; }
+    [[nodiscard]] std::uint64_t const* row(int y) const noexcept { return m_bits.data() + y * m_words; }
+    [[nodiscard]] std::uint64_t* row(int y) noexcept { return m_bits.data() + y * m_words; }
+
+    //Calls f(x, y) for every set cell, row by row.
+    template <typename F>
+    void for_each(F f) const;
+
+private:
+    int m_width = 0;
+    int m_height = 0;
+    int m_words = 0;
+    std::vector<std::uint64_t> m_bits;
+};
+
+//2x2 window kernels. A window is named by its top left cell, so windows.test(x, y)
+//speaks for the cells (x, y), (x + 1, y), (x, y + 1) and (x + 1, y + 1).
+//The output boards must have the same shape as the inputs.
+
+//True when some window is all black.
+[[nodiscard]] bool any_pool(Bitboard const& black);
+
+//Marks in three_black the windows with three black cells and one unknown, and
+//in two_black those with two black cells and two unknowns.
+void pool_threats(Bitboard const& black, Bitboard const& unknown,
+                  Bitboard& three_black, Bitboard& two_black);
+
+//Index of the lowest set bit; bits must not be zero.
+inline int lowest_bit(std::uint64_t const bits) noexcept {
+#if defined(_MSC_VER)
+    unsigned long i;
+    _BitScanForward64(&i, bits);
+    return static_cast<int>(i);
+#else
+    return __builtin_ctzll(bits);
+#endif
+}
+
+template <typename F>
+void Bitboard::for_each(F f) const {
+    for(int y = 0; y < m_height; y++) {
+        std::uint64_t const* const words = row(y);
+        for(int w = 0; w < m_words; w++) {
+            for(std::uint64_t bits = words[w]; bits != 0; bits &= bits - 1) {
+                f(w * 64 + lowest_bit(bits), y);
+            }
+        }
+    }
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <initializer_list>
+#include <memory_resource>
+#include <vector>
+
+//A set of cells of one Grid, by cell index, kept as a sorted vector. The sets
+//the solver builds are small: liberties of a region, the cells one rule marks,
+//a few forbidden cells. A lookup is a short binary search, iteration walks
+//contiguous memory in board order, and a set holds one allocation at most
+//instead of one per cell. Board sized sets are Bitboards. There is no dense
+//form chosen by size: solving the bench corpus, four sets in five hold one
+//cell and none holds more than 512, so an insert shifts at most 2 KiB; a
+//second form would put a branch on the representation in every lookup. A set
+//lives on the heap unless it is given a memory resource, such as the arena
+//Grid keeps for the temporaries of one step; copies always go to the heap.
+class CellSet {
+public:
+    using const_iterator = std::pmr::vector<int>::const_iterator;
+
+    CellSet() = default;
+    explicit CellSet(std::pmr::memory_resource* resource) : m_cells(resource) {}
+    CellSet(std::initializer_list<int> cells, std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : CellSet(cells.begin(), cells.end(), resource) {}
+
+    //The cells may come in any order and more than once.
+    template <typename It>
+    CellSet(It first, It last, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    //Returns whether the cell was new.
+    bool insert(int i);
+    template <typename It>
+    void insert(It first, It last);
+
+    //Returns the number of cells removed, 0 or 1.
+    std::size_t erase(int i);
+
+    [[nodiscard]] bool contains(int i) const noexcept { return std::binary_search(m_cells.begin(), m_cells.end(), i); }
+    [[nodiscard]] bool empty() const noexcept { return m_cells.empty(); }
+    [[nodiscard]] std::size_t size() const noexcept { return m_cells.size(); }
+    [[nodiscard]] const_iterator begin() const noexcept { return m_cells.begin(); }
+    [[nodiscard]] const_iterator end() const noexcept { return m_cells.end(); }
+
+    void clear() noexcept { m_cells.clear(); }
+    //Both sets must use the same memory resource.
+    void swap(CellSet& other) noexcept { m_cells.swap(other.m_cells); }
+
+private:
+    std::pmr::vector<int> m_cells;
+};
+
+template <typename It>
+CellSet::CellSet(It const first, It const last, std::pmr::memory_resource* const resource)
+    : m_cells(first, last, resource) {
+    std::sort(m_cells.begin(), m_cells.end());
+    m_cells.erase(std::unique(m_cells.begin(), m_cells.end()), m_cells.end());
+}
+
+inline bool CellSet::insert(int const i) {
+    auto const at = std::lower_bound(m_cells.begin(), m_cells.end(), i);
+    if(at != m_cells.end() && *at == i) {
+        return false;
+    }
+    m_cells.insert(at, i);
+    return true;
+}
+
+//The new cells are sorted on their own and merged in from the back, into the
+//room resize() made. Both vectors use the set's memory resource; a merge
+//with std::inplace_merge would take its buffer from the heap.
+template <typename It>
+void CellSet::insert(It const first, It const last) {
+    std::pmr::vector<int> added(first, last, m_cells.get_allocator().resource());
+    std::sort(added.begin(), added.end());
+
+    auto i = m_cells.size();
+    auto j = added.size();
+    m_cells.resize(i + j);
+    for(auto k = m_cells.size(); j > 0;) {
+        m_cells[--k] = i > 0 && m_cells[i - 1] > added[j - 1] ? m_cells[--i] : added[--j];
+    }
+    m_cells.erase(std::unique(m_cells.begin(), m_cells.end()), m_cells.end());
+}
+
+inline std::size_t CellSet::erase(int const i) {
+    auto const at = std::lower_bound(m_cells.begin(), m_cells.end(), i);
+    if(at == m_cells.end() || *at != i) {
+        return 0;
+    }
+    m_cells.erase(at);
+    return 1;
+}
@@ -1,84 +1,311 @@
 #include "Grid.hpp"
 #include "Log.hpp"
+#include "ThreadPool.hpp"
 
 #include <sstream>
 #include <assert.h>
 #include <array>
 #include <algorithm>
-#include <queue>
+#include <numeric>
+#include <atomic>
 #include <cstddef>
 #include <utility>
 
-std::regex const Grid::rx{ R"((\d+)|( )|(\n)|[^\d \n])" };
-Grid::Grid(const int width, const int height, std::string_view s)
-    : m_width{width}
-    , m_height{height}
-    , m_total_black{width * height}
-    , m_cells{}
+namespace {
+    //Reads puzzle text in one pass, keeping the line and column for errors.
+    class Scanner {
+    public:
+        explicit Scanner(std::string_view const s) noexcept
+            : m_s{s} {
+        }
+
+        [[nodiscard]] bool done() const noexcept { return m_pos == m_s.size(); }
+        [[nodiscard]] char peek() const noexcept { return m_s[m_pos]; }
+        [[nodiscard]] bool digit() const noexcept { return !done() && peek() >= '0' && peek() <= '9'; }
+
+        void next() noexcept {
+            if(m_s[m_pos] == '\n') {
+                m_line++;
+                m_column = 1;
+            } else {
+                m_column++;
+            }
+            m_pos++;
+        }
+
+        //Reads a run of digits worth 1..limit.
+        int number(int const limit) {
+            if(!digit()) {
+                fail("expected a number");
+            }
+            int n = 0;
+            while(digit()) {
+                n = n * 10 + (peek() - '0');
+                if(n > limit) {
+                    fail("number out of range");
+                }
+                next();
+            }
+            if(n == 0) {
+                fail("number out of range");
+            }
+            return n;
+        }
+
+        void expect(char const c) {
+            if(done() || peek() != c) {
+                fail(std::string("expected '") + c + "'");
+            }
+            next();
+        }
+
+        [[noreturn]] void fail(std::string_view const what) const {
+            std::ostringstream os;
+            os << "Grid::Grid(): line " << m_line << ", column " << m_column << ": " << what;
+            throw std::runtime_error(os.str());
+        }
+
+    private:
+        std::string_view m_s;
+        std::size_t m_pos = 0;
+        int m_line = 1;
+        int m_column = 1;
+    };
+
+    //The "WxH:" in front of a compact puzzle.
+    std::pair<int, int> read_header(Scanner& in) {
+        int constexpr limit = 1 << 14;
+        int const width = in.number(limit);
+        in.expect('x');
+        int const height = in.number(limit);
+        in.expect(':');
+        return { width, height };
+    }
+
+    void write_quoted(std::ostream& os, std::string_view const s) {
+        os << '"';
+        for(char const c : s) {
+            switch(c) {
+                case '"':  os << "\\\"";  break;
+                case '\\': os << "\\\\"; break;
+                case '\n': os << "\\n";   break;
+                default:   os << c;       break;
+            }
+        }
+        os << '"';
+    }
+
+}//end of namespace.
+
+//Counts a call of a phase and the cells it decided, and adds the time it
+//took while timing is on.
+class Grid::PhaseTimer {
+public:
+    PhaseTimer(Grid& grid, Phase const phase) noexcept
+        : m_grid{grid}
+        , m_phase{phase}
+        , m_unknowns{grid.m_unknowns.size()}
+        , m_start{} {
+
+        if constexpr (collect_stats) {
+            if(grid.m_timing) {
+                m_start = std::chrono::steady_clock::now();
+            }
+        }
+    }
+    PhaseTimer(PhaseTimer const& other) = delete;
+    PhaseTimer& operator=(PhaseTimer const& other) = delete;
+    ~PhaseTimer() {
+        if constexpr (collect_stats) {
+            PhaseStats& stats = m_grid.m_stats.phases[m_phase];
+            stats.calls++;
+            stats.decided += static_cast<long long>(m_unknowns - m_grid.m_unknowns.size());
+            if(m_grid.m_timing) {
+                stats.time += std::chrono::steady_clock::now() - m_start;
+            }
+        }
+    }
+
+private:
+    Grid& m_grid;
+    Phase m_phase;
+    std::size_t m_unknowns;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+Grid::Grid(int const width, int const height, std::string_view const s)
+    : Grid({ width, height }, s, Format::PLAIN) {
+}
+
+Grid::Grid(std::string_view const compact)
+    : Grid(compact_size(compact), compact, Format::COMPACT) {
+}
+
+std::pair<int, int> Grid::compact_size(std::string_view const compact) {
+    Scanner in{compact};
+    return read_header(in);
+}
+
+Grid::Grid(std::pair<int, int> const size, std::string_view const s, Format const format)
+    : m_width{size.first}
+    , m_height{size.second}
+    , m_stride{size.first + 2}
+    , m_threads{std::max(1u, std::thread::hardware_concurrency())}
+    , m_total_black{size.first * size.second}
+    , m_states{}
+    , m_parent{}
+    , m_next{}
+    , m_size{}
+    , m_kind{}
+    , m_liberties{}
     , m_sitRep{SitRep::KEEP_GOING}
-    , m_regions{}
-    , m_output{}
-    , m_eng{1729} {
-        
+    , m_roots{}
+    , m_root_pos{}
+    , m_unknowns{}
+    , m_unknown_pos{}
+    , m_dirty{}
+    , m_queued{}
+    , m_black{}
+    , m_white{}
+    , m_unknown{}
+    , m_reach{}
+    , m_reach_from{}
+    , m_reach_owner{}
+    , m_blocked_reach{}
+    , m_blocked_from{}
+    , m_reach_buckets{}
+    , m_reach_epoch{0}
+    , m_epoch{1}
+    , m_footprints{}
+    , m_footprint_saved{}
+    , m_watchers{}
+    , m_footprint_generation{0}
+    , m_probes{}
+    , m_probing{Probing::FULL}
+    , m_local_skip{0}
+    , m_local_backoff{0}
+    , m_timing{false}
+    , m_stats{}
+    , m_trace{}
+    , m_eng{1729}
+    , m_trail{}
+    , m_checkpoints{0}
+    , m_arena_buffer(arena_size)
+    , m_arena{m_arena_buffer.data(), m_arena_buffer.size()} {
+
+    auto const [ width, height ] = size;
     if(width < 1) {
         throw std::runtime_error("The width should be greater than 1");
     }
     if (height < 1) {
         throw std::runtime_error("The height should be greater than 1");
     }
-    m_cells.resize(width, std::vector<std::pair<State, std::shared_ptr<Region>>>
-                        (height, std::make_pair(State::UNKNOWN, std::shared_ptr<Region>())));
+    m_states.resize(m_stride * (height + 2), State::BORDER);
+    m_parent.resize(m_states.size(), -1);
+    m_next.resize(m_states.size(), -1);
+    m_size.resize(m_states.size(), 0);
+    m_kind.resize(m_states.size(), State::UNKNOWN);
+    m_liberties.resize(m_states.size());
+    m_root_pos.resize(m_states.size(), -1);
+    m_roots.reserve(width * height);
+    m_unknown_pos.resize(m_states.size(), -1);
+    m_unknowns.reserve(width * height);
+    m_queued.resize(m_states.size(), 0);
+    m_reach.resize(m_states.size(), -1);
+    m_reach_from.resize(m_states.size(), -1);
+    m_reach_owner.resize(m_states.size(), -1);
+    m_blocked_reach.resize(m_states.size(), -1);
+    m_blocked_from.resize(m_states.size(), -1);
+    m_footprints.resize(m_states.size());
+    m_watchers.resize(m_states.size());
+    m_black = Bitboard(width, height);
+    m_white = Bitboard(width, height);
+    m_unknown = Bitboard(width, height);
+
+    for(auto y = 0; y < height; y++) {
+        std::fill_n(m_states.begin() + index(0, y), width, State::UNKNOWN);
+    }
 
-    std::vector<int> vec_grid;
-    vec_grid.reserve(width * height);
-    char const* c = s.data();
-    for(std::cregex_iterator i {c, c + std::strlen(c), rx}, end; i != end; i++) {
-        std::cmatch const& m = *i;
-        if(m[1].matched) {
-            vec_grid.push_back(std::stoi(m[1]));
+    Scanner in{s};
+    if(format == Format::COMPACT) {
+        read_header(in);
+    }
 
-        } else if(m[2].matched) {
-            vec_grid.push_back(0);
+    //Cells arrive row by row, so a numbered cell only has to be checked
+    //against the ones above and to the left. `at` is where the cell was read.
+    int cells = 0;
+    auto const put = [&](int const n, Scanner const& at) {
+        if(cells == width * height) {
+            at.fail("more than width * height cells");
+        }
+        int const x = cells % width;
+        int const y = cells / width;
+        cells++;
+
+        if(n > 0) {
+            if((valid(x, y - 1) && static_cast<int>(cell(x, y - 1)) > 0)
+            || (valid(x - 1, y) && static_cast<int>(cell(x - 1, y)) > 0)) {
+                at.fail("numbered cells cannot be adjacent");
+            }
+
+            cell(x, y) = static_cast<State>(n);
+            add_region(x, y);
+
+            //Get the total number of black cells in the grid.
+            m_total_black -= n;
+        }
+    };
 
-        } else if(m[3].matched) {
+    while(!in.done()) {
+        char const c = in.peek();
+        if(in.digit()) {
+            Scanner const at = in;
+            put(in.number(width * height), at);
+            continue;
+        }
+        if(c == '\n' || c == '\r') {
             //do nothing.
 
-        } else {
-            throw std::runtime_error("Grid::Grid(): Grid initialization contains invalid string.");
+        } else if(format == Format::PLAIN && c == ' ') {
+            put(0, in);
+
+        } else if(format == Format::COMPACT && c == '.') {
+            put(0, in);
+
+        } else if(format == Format::COMPACT && c >= 'a' && c <= 'z') {
+            for(int k = 0; k <= c - 'a'; k++) {
+                put(0, in);
+            }
+
+        } else if(format != Format::COMPACT || c != ',') {
+            in.fail(std::string("unexpected character '") + c + "'");
         }
+        in.next();
     }
 
-    if(vec_grid.size() != static_cast<size_t>(width * height)) 
-        throw std::runtime_error("grid must contains \"width * height\" spaces and numbers.");
-        
-    for(auto x = 0; x < width; x++) {
-        for(auto y = 0; y < height; y++) {
-            int const n = vec_grid[x + y * width];
-
-            if(n > 0) { 
-                if (valid(x, y - 1) && static_cast<int>(cell(x, y - 1)) > 0) {
-                    throw std::runtime_error("Grid::Grid() the vertical adjacent cell "
-                        "cannot be numbered.");
-                }
-                
-                cell(x, y) = static_cast<State>(n);
-                add_region(x, y);
+    if(cells != width * height) {
+        in.fail("fewer than width * height cells");
+    }
 
-                //Get the total number of black cells in the grid.
-                m_total_black -= n;
-            }
+    for(auto i = index(0, 0); i < index(0, height); i++) {
+        if(m_states[i] == State::UNKNOWN) {
+            m_unknown_pos[i] = static_cast<int>(m_unknowns.size());
+            m_unknowns.push_back(i);
+        }
+        if(m_states[i] != State::BORDER) {
+            set_bits(i, m_states[i]);
         }
     }
 
+    set_trace(true);
     print("I'm okay to go!");
 }
 
-Grid::SitRep Grid::solve(bool const verbose, bool const guessing) {
-
-    cache_map_t cache;
+Grid::SitRep Grid::solve(bool const verbose, bool const guessing, steady_clock_tp const deadline) {
+    m_arena.release();
 
     if(knownElements() == m_width * m_height) {
-        if(detect_contradictions(verbose, cache)) {
+        if(detect_contradictions(verbose)) {
             return SitRep::CONTRADICTION_FOUND;
         }
 
@@ -93,9 +320,9 @@ Grid::SitRep Grid::solve(bool const verbose, bool const guessing) {
         || analyze_dual_liberties(verbose)
         || analyze_unreachable_cells(verbose)
         || analyze_potential_pools(verbose)
-        || detect_contradictions(verbose, cache)
-        || analyze_confinement(verbose, cache)
-        || (guessing && analyze_hypotheticals(verbose))) {
+        || detect_contradictions(verbose)
+        || analyze_confinement(verbose)
+        || (guessing && analyze_hypotheticals(verbose, false, deadline))) {
 
             return m_sitRep;
     }
@@ -107,16 +334,125 @@ Grid::SitRep Grid::solve(bool const verbose, bool const guessing) {
     return SitRep::CANNOT_PROCEED;
 }
 
+Grid::SitRep Grid::solve_local() {
+    m_arena.release();
+
+    if(knownElements() == m_width * m_height) {
+        return solve(false, false);
+    }
+    if(analyze_complete_islands(false)
+        || analyze_single_liberty(false)
+        || analyze_dual_liberties(false)
+        || analyze_potential_pools(false, true)) {
+
+            return m_sitRep;
+    }
+    if(any_pool(m_black)) {
+        write(Change::SITREP, 0, static_cast<int>(SitRep::CONTRADICTION_FOUND));
+        return SitRep::CONTRADICTION_FOUND;
+    }
+    return SitRep::CANNOT_PROCEED;
+}
+
+void Grid::set_threads(unsigned const threads) noexcept {
+    m_threads = std::max(1u, threads);
+}
+
+void Grid::set_probing(Probing const probing) noexcept {
+    m_probing = probing;
+    m_local_skip = 0;
+    m_local_backoff = 0;
+}
+
+std::string_view Grid::phase_name(Phase const phase) noexcept {
+    switch(phase) {
+        case PHASE_COMPLETE_ISLANDS:  return "analyze_complete_islands";
+        case PHASE_SINGLE_LIBERTY:    return "analyze_single_liberty";
+        case PHASE_DUAL_LIBERTIES:    return "analyze_dual_liberties";
+        case PHASE_UNREACHABLE_CELLS: return "analyze_unreachable_cells";
+        case PHASE_POTENTIAL_POOLS:   return "analyze_potential_pools";
+        case PHASE_CONTRADICTIONS:    return "detect_contradictions";
+        case PHASE_CONFINEMENT:       return "analyze_confinement";
+        case PHASE_HYPOTHETICALS:     return "analyze_hypotheticals";
+        case PHASE_CONFINED:          return "confined";
+        case PHASE_COMPUTE_REACH:     return "compute_reach";
+        default:                      return "unknown";
+    }
+}
+
+void Grid::set_timing(bool const on) noexcept {
+    m_timing = on;
+}
+
+Grid::Stats const& Grid::stats() const noexcept {
+    return m_stats;
+}
+
+void Grid::reset_stats() noexcept {
+    m_stats = {};
+}
+
+Grid::Stats& Grid::Stats::operator+=(Stats const& other) noexcept {
+    for(auto p = 0; p < PHASE_COUNT; p++) {
+        phases[p].calls += other.phases[p].calls;
+        phases[p].decided += other.phases[p].decided;
+        phases[p].time += other.phases[p].time;
+    }
+    footprint_hits += other.footprint_hits;
+    footprint_misses += other.footprint_misses;
+    reach_hits += other.reach_hits;
+    reach_misses += other.reach_misses;
+    copies += other.copies;
+    guesses += other.guesses;
+    probe_hits += other.probe_hits;
+    probe_misses += other.probe_misses;
+    local_guesses += other.local_guesses;
+    local_wins += other.local_wins;
+    escalations += other.escalations;
+    search_nodes += other.search_nodes;
+    search_conflicts += other.search_conflicts;
+    search_restarts += other.search_restarts;
+    return *this;
+}
+
+void Grid::Stats::write_json(std::ostream& os) const {
+    os << "{\"phases\":{";
+    for(auto p = 0; p < PHASE_COUNT; p++) {
+        os << (p > 0 ? "," : "") << '"' << phase_name(static_cast<Phase>(p)) << "\":{"
+           << "\"calls\":" << phases[p].calls
+           << ",\"decided\":" << phases[p].decided
+           << ",\"time_ns\":" << phases[p].time.count() << '}';
+    }
+    os << "},\"footprint_hits\":" << footprint_hits
+       << ",\"footprint_misses\":" << footprint_misses
+       << ",\"reach_hits\":" << reach_hits
+       << ",\"reach_misses\":" << reach_misses
+       << ",\"copies\":" << copies
+       << ",\"guesses\":" << guesses
+       << ",\"probe_hits\":" << probe_hits
+       << ",\"probe_misses\":" << probe_misses
+       << ",\"local_guesses\":" << local_guesses
+       << ",\"local_wins\":" << local_wins
+       << ",\"escalations\":" << escalations
+       << ",\"search_nodes\":" << search_nodes
+       << ",\"search_conflicts\":" << search_conflicts
+       << ",\"search_restarts\":" << search_restarts << '}';
+}
+
 int Grid::knownElements() const {
-    int ret = 0;
-    for(auto x = 0; x < m_width; x++){
-        for(auto y = 0; y < m_height; y++){
-            if(cell(x, y) != State::UNKNOWN){
-                ret++;
-            }
+    return m_width * m_height - static_cast<int>(m_unknowns.size());
+}
+
+std::string Grid::board() const {
+    std::string s;
+    s.reserve(m_width * m_height);
+    for(auto y = 0; y < m_height; y++) {
+        for(auto x = 0; x < m_width; x++) {
+            State const state = cell(x, y);
+            s += state == State::BLACK ? '#' : state == State::UNKNOWN ? '?' : '.';
         }
     }
-    return ret;
+    return s;
 }
 
 void Grid::write(std::ostream& os, steady_clock_tp start, steady_clock_tp finish) const {
@@ -152,111 +488,175 @@ void Grid::write(std::ostream& os, steady_clock_tp start, steady_clock_tp finish
     </head>
     <body>)";
 
-    std::chrono::steady_clock::time_point old_ctr = start;
+    steady_clock_tp old_ctr = start;
 
-    for(const auto& [ s, v, updated, ctr, failed_guesses,failed_coords ]: m_output) {
-        os << s << " (" << format_time(old_ctr, ctr) << ")\n";
+    m_trace.replay([&](Trace::Step const& step, Trace::View const& view) {
+        os << step.message << " (" << format_time(old_ctr, step.time) << ")\n";
 
-        if(failed_guesses == 1) {
+        if(step.failed_guesses == 1) {
             os << "<br/>1 guess failed.\n";
-        } else if(failed_guesses > 0) {
-            os << "<br/>" << failed_guesses << " guesses failed.\n";
+        } else if(step.failed_guesses > 0) {
+            os << "<br/>" << step.failed_guesses << " guesses failed.\n";
         }
 
-        old_ctr = ctr;
+        old_ctr = step.time;
 
         os << "<table>\n";
 
         for(int y = 0; y < m_height; y++) {
             os << "<tr>";
             for(int x = 0; x < m_width; x++) {
+                int const c = x + y * m_width;
                 os << "<td class=\"";
-                os << (updated.find(std::make_pair(x, y)) != updated.end() ? "new " : "old ");
+                os << (view.changed(c) ? "new " : "old ");
 
-                if(failed_coords.find(std::make_pair(x, y)) != failed_coords.end()) {
+                if(view.failed(c)) {
                     os << "failed ";
                 }
 
-                switch(v[x][y]) {
+                switch(static_cast<State>(view.value(c))) {
                     case State::UNKNOWN:    os << "unknown\">";       break;
                     case State::WHITE:      os << "white\">.";         break;
                     case State::BLACK:      os << "black\">#";         break;
                     default: 
-                        os << "number\">" << static_cast<int>(v[x][y]);      break;
+                        os << "number\">" << view.value(c);      break;
                 }
                 os << "</td>";
             }
             os << "</tr>\n";
         }
         os << "</table><br/>\n";
-    }
+    });
     os << "Total time taken: " << format_time(start, finish) << '\n';
     os << 
         " </body>\n"
         "</html>\n";
 }
-#pragma region
-Grid::Region::Region(State const state, set_pair_t const& unknowns, int const x, int const y)
-    : m_state{state}
 
-    //Tracks the region.
-    , m_coords{}
+void Grid::write_trace_json(std::ostream& os) const {
+    auto const write_cell = [&](int const value) {
+        switch(static_cast<State>(value)) {
+            case State::UNKNOWN: os << "\"?\""; break;
+            case State::WHITE:   os << "\".\""; break;
+            case State::BLACK:   os << "\"#\""; break;
+            default:             os << value;  break;
+        }
+    };
 
-    //Tracks unknown cells surround the region.
-    , m_unknowns{unknowns} {
+    //Cells are numbered x + y * width; times are microseconds since the first step.
+    os << "{\"width\":" << m_width << ",\"height\":" << m_height << ",\"start\":[";
+    for(std::size_t c = 0; c < m_trace.start().size(); c++) {
+        os << (c > 0 ? "," : "");
+        write_cell(m_trace.start()[c]);
+    }
+    os << "],\"steps\":[";
+
+    std::size_t changes = 0;
+    std::size_t failed = 0;
+    for(auto const& step : m_trace.steps()) {
+        auto const us = std::chrono::duration_cast<std::chrono::microseconds>(
+            step.time - m_trace.steps().front().time).count();
+
+        os << (&step != m_trace.steps().data() ? "," : "") << "{\"message\":";
+        write_quoted(os, step.message);
+        os << ",\"us\":" << us << ",\"failed_guesses\":" << step.failed_guesses << ",\"changes\":[";
+        for(auto const first = changes; changes < step.changes_end; changes++) {
+            auto const [ c, value ] = m_trace.changes()[changes];
+            os << (changes > first ? "," : "") << '[' << c << ',';
+            write_cell(value);
+            os << ']';
+        }
+        os << "],\"failed\":[";
+        for(auto const first = failed; failed < step.failed_end; failed++) {
+            os << (failed > first ? "," : "") << m_trace.failed()[failed];
+        }
+        os << "]}";
+    }
+    os << "]}";
+}
 
-    assert(state != State::UNKNOWN);
+void Grid::set_trace(bool const on) {
+    if(!on) {
+        m_trace = Trace();
+        return;
+    }
+    if(m_trace.recording()) {
+        return;
+    }
+    std::vector<int> start;
+    start.reserve(m_width * m_height);
+    for(auto y = 0; y < m_height; y++) {
+        for(auto x = 0; x < m_width; x++) {
+            start.push_back(static_cast<int>(cell(x, y)));
+        }
+    }
+    m_trace = Trace(m_width, std::move(start));
+}
+#pragma region
+Grid::Region::iterator::iterator(Grid const* grid, int const start, int const curr) noexcept
+    : m_grid{grid}
+    , m_start{start}
+    , m_curr{curr} {
+}
 
-    //create the region.
-    m_coords.insert(std::make_pair(x, y));
+std::pair<int, int> Grid::Region::iterator::operator*() const noexcept {
+    return m_grid->coords(m_curr);
 }
 
+Grid::Region::iterator& Grid::Region::iterator::operator++() noexcept {
+    m_curr = m_grid->m_next[m_curr];
+    if(m_curr == m_start) {
+        m_curr = -1;
+    }
+    return *this;
+}
+
+Grid::State Grid::Region::kind() const noexcept {
+    return m_grid->m_kind[m_root];
+}
 
 int Grid::Region::its_number() const noexcept {
     assert(is_numbered());
-    return static_cast<int>(m_state);
+    return static_cast<int>(kind());
 }
 
-Grid::set_pair_t::const_iterator Grid::Region::begin() const {
-    return m_coords.begin();
+Grid::Region::iterator Grid::Region::begin() const noexcept {
+    return iterator(m_grid, m_root, m_root);
 }
 
-Grid::set_pair_t::const_iterator Grid::Region::end() const {
-    return m_coords.end();
+Grid::Region::iterator Grid::Region::end() const noexcept {
+    return iterator(m_grid, m_root, -1);
 }
 
 int Grid::Region::size() const noexcept {
-    return static_cast<int>(m_coords.size());
+    return m_grid->m_size[m_root];
 }
 
 bool Grid::Region::contains(int const x, int const y) const noexcept {
-    return m_coords.find(std::make_pair(x, y)) != m_coords.end();
+    return m_grid->region(x, y) == *this;
 }
 
-Grid::set_pair_t::const_iterator Grid::Region::unk_begin() const {
-    return m_unknowns.begin();
+CellSet::const_iterator Grid::Region::unk_begin() const {
+    return m_grid->m_liberties[m_root].begin();
 }
 
-Grid::set_pair_t::const_iterator Grid::Region::unk_end() const {
-    return m_unknowns.end();
+CellSet::const_iterator Grid::Region::unk_end() const {
+    return m_grid->m_liberties[m_root].end();
 }
 
 int Grid::Region::unk_size() const noexcept {
-    return static_cast<int>(m_unknowns.size());
-}
-
-void Grid::Region::unk_erase(int const x, int const y) noexcept {
-    m_unknowns.erase(std::make_pair(x, y));
+    return static_cast<int>(m_grid->m_liberties[m_root].size());
 }
 #pragma endregion
 
 bool Grid::analyze_complete_islands(bool verbose) {
+    PhaseTimer const timer{*this, PHASE_COMPLETE_ISLANDS};
 
-    set_pair_t mark_as_black;
-    set_pair_t mark_as_white;
+    CellSet mark_as_black(&m_arena);
+    CellSet mark_as_white(&m_arena);
 
-    for(auto const& region : m_regions){
-        auto const& r = *region;
+    for(int const root : take_dirty(RULE_COMPLETE_ISLANDS)){
+        Region const r(*this, root);
         if(r.is_numbered() && r.size() == r.its_number()){
             mark_as_black.insert(r.unk_begin(), r.unk_end());
         }
@@ -266,11 +666,12 @@ bool Grid::analyze_complete_islands(bool verbose) {
 }
 
 bool Grid::analyze_single_liberty(bool verbose) {
-    set_pair_t mark_as_black;
-    set_pair_t mark_as_white;
+    PhaseTimer const timer{*this, PHASE_SINGLE_LIBERTY};
+    CellSet mark_as_black(&m_arena);
+    CellSet mark_as_white(&m_arena);
 
-    for(auto const& region : m_regions) {
-        auto const& r = *region;
+    for(int const root : take_dirty(RULE_SINGLE_LIBERTY)) {
+        Region const r(*this, root);
         bool const partial = (r.is_black() && r.size() < m_total_black)
                             || r.is_white() 
                             || (r.is_numbered() && r.size() < r.its_number());
@@ -291,17 +692,15 @@ bool Grid::analyze_single_liberty(bool verbose) {
 }
 
 bool Grid::analyze_dual_liberties(bool verbose) {
-    set_pair_t mark_as_black;
-    set_pair_t mark_as_white;
+    PhaseTimer const timer{*this, PHASE_DUAL_LIBERTIES};
+    CellSet mark_as_black(&m_arena);
+    CellSet mark_as_white(&m_arena);
 
-    for(auto const& region: m_regions){
-        Region const& r = *region;
+    for(int const root : take_dirty(RULE_DUAL_LIBERTIES)){
+        Region const r(*this, root);
         if(r.is_numbered() && r.size() == r.its_number() - 1 && r.unk_size() == 2){
-            int const x1 = r.unk_begin()->first;
-            int const y1 = r.unk_begin()->second;
-
-            int const x2 = std::next(r.unk_begin())->first;
-            int const y2 = std::next(r.unk_begin())->second;
+            auto const [ x1, y1 ] = coords(*r.unk_begin());
+            auto const [ x2, y2 ] = coords(*std::next(r.unk_begin()));
 
             if(std::abs(x1 - x2) == 1 && std::abs(y1 - y2) == 1) {
                 std::pair<int, int> p;
@@ -314,7 +713,7 @@ bool Grid::analyze_dual_liberties(bool verbose) {
                 }
 
                 if (cell(p.first, p.second) == State::UNKNOWN) {
-                    mark_as_black.insert(p);
+                    mark_as_black.insert(index(p.first, p.second));
                 }
             }
                
@@ -325,15 +724,16 @@ bool Grid::analyze_dual_liberties(bool verbose) {
 }
 
 bool Grid::analyze_unreachable_cells(bool verbose) {
+    PhaseTimer const timer{*this, PHASE_UNREACHABLE_CELLS};
 
-    set_pair_t mark_as_black;
-    set_pair_t mark_as_white;
+    CellSet mark_as_black(&m_arena);
+    CellSet mark_as_white(&m_arena);
 
-    for(auto x = 0; x < m_width; x++) {
-        for(auto y = 0; y < m_height; y++) {
-            if(unreachable(x, y)) {
-                mark_as_black.insert(std::make_pair(x, y));
-            }
+    compute_reach();
+
+    for(int const i : m_unknowns) {
+        if(m_reach[i] < 0) {
+            mark_as_black.insert(i);
         }
     }
        
@@ -341,96 +741,87 @@ bool Grid::analyze_unreachable_cells(bool verbose) {
 
 }
 
-bool Grid::analyze_potential_pools(bool verbose) {
-    set_pair_t mark_as_black;
-    set_pair_t mark_as_white;
-
-    for(auto x = 0; x < m_width - 1; x++) {
-        for(auto y = 0; y < m_height - 1; y++) {
-
-            struct XY {
-                int x;
-                int y;
-                State state;
-            };
-            std::array<XY, 4> quadrant { {
-                { x, y, cell(x, y) },
-                { x + 1, y, cell(x + 1, y) },
-                { x, y + 1, cell(x, y + 1) },
-                { x + 1, y + 1, cell(x + 1, y + 1) }
-            } };
-
-            static_assert(State::BLACK > State::UNKNOWN, " Black should be greater than state::unknown.");
+bool Grid::analyze_potential_pools(bool verbose, bool const local) {
+    PhaseTimer const timer{*this, PHASE_POTENTIAL_POOLS};
+    CellSet mark_as_black(&m_arena);
+    CellSet mark_as_white(&m_arena);
 
-            std::sort(begin(quadrant), end(quadrant), [](auto const lhs, auto const rhs){
-                return lhs.state < rhs.state;
-            });
+    Bitboard three_black(m_width, m_height);
+    Bitboard two_black(m_width, m_height);
+    pool_threats(m_black, m_unknown, three_black, two_black);
 
-            if(quadrant[0].state == State::UNKNOWN
-            && quadrant[1].state == State::BLACK
-            && quadrant[2].state == State::BLACK
-            && quadrant[3].state == State::BLACK) {
+    auto const window = [this](int const x, int const y) {
+        int const k = index(x, y);
+        return std::array<int, 4>{ { k, k + 1, k + m_stride, k + m_stride + 1 } };
+    };
 
-                mark_as_white.insert(std::make_pair(quadrant[0].x, quadrant[0].y));
-                
-            } else if(quadrant[0].state == State::UNKNOWN
-                    && quadrant[1].state == State::UNKNOWN
-                    && quadrant[2].state == State::BLACK
-                    && quadrant[3].state == State::BLACK) {
-                    
-                        for(auto i = 0; i < 2; i++) {
-                            set_pair_t imagine_black;
-                            imagine_black.insert(std::make_pair(quadrant[0].x, quadrant[0].y));
+    //Three black cells: the fourth must be white.
+    three_black.for_each([&](int const x, int const y) {
+        for(int const i : window(x, y)) {
+            if(m_states[i] == State::UNKNOWN) {
+                mark_as_white.insert(i);
+            }
+        }
+    });
 
-                            if(unreachable(quadrant[1].x, quadrant[1].y, imagine_black)) {
-                                mark_as_white.insert(std::make_pair(quadrant[0].x, quadrant[0].y));
-                            }
+    if(local) {
+        return process(verbose, mark_as_black, mark_as_white, " Analysis the potential pool. ");
+    }
 
-                            std::swap(quadrant[0], quadrant[1]);
-                        }
-                    }
+    //Two black cells: if the other unknown cannot be reached once this one is
+    //black, both would be black and complete the pool.
+    two_black.for_each([&](int const x, int const y) {
+        std::array<int, 2> unknowns{};
+        int n = 0;
+        for(int const i : window(x, y)) {
+            if(m_states[i] == State::UNKNOWN) {
+                unknowns[n++] = i;
+            }
         }
-    }
+        for(auto i = 0; i < 2; i++) {
+            if(!reachable_without(unknowns[1], unknowns[0])) {
+                mark_as_white.insert(unknowns[0]);
+            }
+            std::swap(unknowns[0], unknowns[1]);
+        }
+    });
 
     return process(verbose, mark_as_black, mark_as_white, " Analysis the potential pool. ");
 }
 
-bool Grid::analyze_confinement(bool verbose, cache_map_t& cache) {
-    set_pair_t mark_as_black;
-    set_pair_t mark_as_white;
+bool Grid::analyze_confinement(bool verbose) {
+    PhaseTimer const timer{*this, PHASE_CONFINEMENT};
+    CellSet mark_as_black(&m_arena);
+    CellSet mark_as_white(&m_arena);
         
-    for(auto x = 0; x < m_width; x++) {
-        for(auto y = 0; y < m_height; y++) {
-            if(cell(x, y) == State::UNKNOWN) {
-                set_pair_t verboten;
-                verboten.insert(std::make_pair(x, y));
+    for(int const i : m_unknowns) {
+        CellSet const verboten({ i }, &m_arena);
 
-                for(auto const& sp : m_regions) {
-                    auto const& r = *sp;
-                    if(confined(sp, cache, verboten)) {
-                        if(r.is_black()) {
-                            mark_as_black.insert(std::make_pair(x, y));
+        for(int const root : m_roots) {
+            Region const r(*this, root);
+            if(confined(r, verboten)) {
+                if(r.is_black()) {
+                    mark_as_black.insert(i);
 
-                        } else {
-                            mark_as_white.insert(std::make_pair(x, y));
+                } else {
+                    mark_as_white.insert(i);
 
-                        }
-                    }
                 }
             }
         }
     }
-    for(auto const& sp1 : m_regions) {
-        auto const& r = *sp1;
+    for(int const root1 : m_roots) {
+        Region const r(*this, root1);
         if(r.is_numbered() && r.size() < r.its_number()) {
             for(auto u{r.unk_begin()}; u != r.unk_end(); ++u) {
-                set_pair_t verboten;
-                verboten.insert(*u);
+                CellSet verboten({ *u }, &m_arena);
 
-                insert_valid_neighbors(verboten, u->first, u->second);
+                auto const [ x, y ] = coords(*u);
+                insert_valid_neighbors(verboten, x, y);
 
-                for(auto const& sp2 : m_regions) {
-                    if(sp2 != sp1 && sp2->is_numbered() && confined(sp2, cache, verboten)) {
+                for(int const root2 : m_roots) {
+                    Region const r2(*this, root2);
+                    if(r2 != r && r2.is_numbered() && confined(r2, verboten)) {
                         mark_as_black.insert(*u);
                     }
                 }
@@ -442,46 +833,242 @@ bool Grid::analyze_confinement(bool verbose, cache_map_t& cache) {
     return process(verbose, mark_as_black, mark_as_white, "Confinment analysis succeeded.");
 }
 
-bool Grid::analyze_hypotheticals(bool verbose) {
-    set_pair_t mark_as_black;
-    set_pair_t mark_as_white;
+bool Grid::analyze_hypotheticals(bool verbose, bool const refute_only, steady_clock_tp const deadline) {
+    PhaseTimer const timer{*this, PHASE_HYPOTHETICALS};
+    CellSet mark_as_black(&m_arena);
+    CellSet mark_as_white(&m_arena);
     const std::vector<std::pair<int, int>> v = guessing_order();
-    int failed_guesses = 0;
-    set_pair_t failed_coords;
+    int const n = static_cast<int>(v.size());
+
+    //Guesses are handed out in rank order and the lowest ranked decisive guess
+    //wins, so the outcome is the same for any number of threads. A worker
+    //gives up, even in the middle of a guess, once a lower rank has won.
+    //A guess is decisive when a color ends in a contradiction or a solution,
+    //or when both colors run dry but agree on some cells: whatever the color
+    //of the guess, those cells are forced.
+    struct Outcome {
+        int color = 0;
+        SitRep sitrep = SitRep::KEEP_GOING;
+        std::vector<std::pair<int, State>> forced;
+        Probe probe;
+    };
+    std::atomic<int> best{n};
+    std::vector<Outcome> outcomes(v.size());
+    m_probes.resize(m_states.size());
+
+    //Probes the guesses of the given ranks, in order. With reuse, a guess
+    //whose probe still holds is skipped and its rank is left in `skipped`.
+    //Only probes with all rules are kept for reuse.
+    auto const probe = [&](std::vector<int> const& ranks, bool const reuse, std::vector<int>& skipped,
+                           bool const local) {
+        std::atomic<std::size_t> next{0};
+        std::mutex skipped_mutex;
+
+        ThreadPool::shared().run(m_threads, [&](unsigned) {
+            //Each worker copies the board once and undoes every guess on it.
+            std::unique_ptr<Grid> other;
+            //What the first color decided of this board's unknowns.
+            std::vector<State> first_color(m_unknowns.size());
+            std::vector<unsigned char> in_footprint(m_states.size(), 0);
+            long long hits = 0;
+            long long misses = 0;
+
+            for(std::size_t pos = next++; pos < ranks.size() && ranks[pos] < best.load(); pos = next++) {
+                if(deadline != steady_clock_tp::max() && std::chrono::steady_clock::now() >= deadline) {
+                    break;
+                }
+                int const rank = ranks[pos];
+                auto const& [ x, y ] = v[rank];
+                int const c = index(x, y);
+
+                Probe const& last = m_probes[c];
+                if (reuse && !last.footprint.empty() && all_unknown(last.footprint)) {
+                    hits++;
+                    std::lock_guard lock{skipped_mutex};
+                    skipped.push_back(rank);
+                    continue;
+                }
+                misses++;
 
-    for(auto const& [ x, y ] : v) {
-        for (auto i = 0; i < 2; i++) {
-            State const color = i == 0 ? State::BLACK : State::WHITE;
-            auto& mark_as_same = i == 0 ? mark_as_black : mark_as_white;
-            auto& mark_as_diff = i == 0 ? mark_as_white : mark_as_black;
+                if (!other) {
+                    other.reset(new Grid(*this));
+                }
+                if constexpr (collect_stats) {
+                    other->m_stats.guesses++;
+                    if (local) {
+                        other->m_stats.local_guesses++;
+                    }
+                }
+                for (auto i = 0; i < 2; i++) {
+                    State const color = i == 0 ? State::BLACK : State::WHITE;
 
-            Grid other(*this);
-            other.mark(color, x, y);
+                    std::size_t const cp = other->checkpoint();
+                    other->mark(color, x, y);
 
-            SitRep sr = SitRep::KEEP_GOING;
+                    SitRep sr = SitRep::KEEP_GOING;
 
-            while (sr == SitRep::KEEP_GOING) {
-                sr = other.solve(false, false);
-            }
-            if (sr == SitRep::CONTRADICTION_FOUND) {
-                mark_as_diff.insert(std::make_pair(x, y));
-                Logger::lg.msg("[WARNING] 481 Hypothetical Contradiction found!");
-                return process(verbose, mark_as_black, mark_as_white, "Hypothetical contradiction!",
-                    failed_guesses, failed_coords);
+                    while (sr == SitRep::KEEP_GOING && rank < best.load(std::memory_order_relaxed)) {
+                        sr = local ? other->solve_local() : other->solve(false, false);
+                    }
+
+                    bool decisive = sr == SitRep::CONTRADICTION_FOUND
+                        || (sr == SitRep::SOLUTION_FOUND && !refute_only);
+                    if (!decisive && i == 0) {
+                        for (std::size_t k = 0; k < m_unknowns.size(); k++) {
+                            first_color[k] = other->m_states[m_unknowns[k]];
+                        }
+                    } else if (!decisive) {
+                        //The footprint starts with the guess and the cells
+                        //either color decided; their neighbors follow.
+                        std::vector<std::pair<int, State>> forced;
+                        std::vector<int>& footprint = outcomes[rank].probe.footprint;
+                        auto const touch = [&](int const j) {
+                            if (m_states[j] == State::UNKNOWN && !in_footprint[j]) {
+                                in_footprint[j] = 1;
+                                footprint.push_back(j);
+                            }
+                        };
+                        touch(c);
+                        for (std::size_t k = 0; k < m_unknowns.size(); k++) {
+                            State const state = other->m_states[m_unknowns[k]];
+                            if (state != State::UNKNOWN && state == first_color[k]) {
+                                forced.emplace_back(m_unknowns[k], state);
+                            }
+                            if (state != State::UNKNOWN || first_color[k] != State::UNKNOWN) {
+                                touch(m_unknowns[k]);
+                            }
+                        }
+                        for (std::size_t k = 0, decided = footprint.size(); k < decided; k++) {
+                            int const j = footprint[k];
+                            for (int const d : { -1, 1, -m_stride, m_stride }) {
+                                touch(j + d);
+                            }
+                        }
+                        for (int const j : footprint) {
+                            in_footprint[j] = 0;
+                        }
+                        if (local) {
+                            footprint.clear();
+                        }
+
+                        decisive = !forced.empty();
+                        outcomes[rank].forced = std::move(forced);
+                    }
+                    other->rollback(cp);
+
+                    if (decisive) {
+                        outcomes[rank].color = i;
+                        outcomes[rank].sitrep = sr;
 
+                        int b = best.load();
+                        while (rank < b && !best.compare_exchange_weak(b, rank)) { }
+                        break;
+                    }
+                }
             }
-            if (sr == SitRep::SOLUTION_FOUND) {
-                mark_as_same.insert(std::make_pair(x, y));
-                Logger::lg.msg("[INFO] 477 Hypothetical solution found!");
-                return process(verbose, mark_as_black, mark_as_white, "Hypothetical Solution!",
-                    failed_guesses, failed_coords);
 
+            if constexpr (collect_stats) {
+                std::lock_guard lock{mt};
+                if (other) {
+                    m_stats += other->m_stats;
+                    m_stats.copies++;
+                }
+                m_stats.probe_hits += hits;
+                m_stats.probe_misses += misses;
             }
-            failed_guesses++;
-            failed_coords.insert(std::make_pair(x, y));
+        });
+    };
+
+    std::vector<int> ranks(v.size());
+    std::iota(ranks.begin(), ranks.end(), 0);
+    std::vector<int> skipped;
+
+    bool const local = m_probing == Probing::LOCAL_FIRST || (m_probing == Probing::ADAPTIVE && m_local_skip == 0);
+    if (m_local_skip > 0) {
+        m_local_skip--;
+    }
+    if (local) {
+        probe(ranks, true, skipped, true);
+        skipped.clear();
+
+        bool const won = best.load() < n;
+        if constexpr (collect_stats) {
+            (won ? m_stats.local_wins : m_stats.escalations)++;
+        }
+        if (m_probing == Probing::ADAPTIVE) {
+            m_local_backoff = won ? 0 : std::min(2 * m_local_backoff + 1, 15);
+            m_local_skip = m_local_backoff;
         }
     }
-    return false;
+    if (best.load() == n) {
+        probe(ranks, true, skipped, false);
+    }
+
+    //Only when everything else is exhausted are the skipped guesses probed
+    //again, so that reuse never costs a deduction.
+    if (best.load() == n && !skipped.empty()) {
+        std::sort(skipped.begin(), skipped.end());
+        std::vector<int> none;
+        probe(skipped, false, none, false);
+    }
+
+    //Every rank below the winner was probed to the end, whatever the number
+    //of threads, so their probes can be kept.
+    for (int rank = 0; rank < best.load(); rank++) {
+        if (!outcomes[rank].probe.footprint.empty()) {
+            auto const [ x, y ] = v[rank];
+            m_probes[index(x, y)] = std::move(outcomes[rank].probe);
+        }
+    }
+
+    int const rank = best.load();
+    if (rank == n) {
+        return false;
+    }
+
+    int const i = outcomes[rank].color;
+    SitRep const sr = outcomes[rank].sitrep;
+    auto const& forced = outcomes[rank].forced;
+    auto const [ x, y ] = v[rank];
+    auto& mark_as_same = i == 0 ? mark_as_black : mark_as_white;
+    auto& mark_as_diff = i == 0 ? mark_as_white : mark_as_black;
+
+    //Every guess ranked before the winner failed with both colors, or was
+    //skipped for having failed before.
+    int const failed_guesses = 2 * rank + i;
+    CellSet failed_cells(&m_arena);
+    for (auto k = 0; k < rank; k++) {
+        failed_cells.insert(index(v[k].first, v[k].second));
+    }
+
+    if (!forced.empty()) {
+        for (auto const& [ j, state ] : forced) {
+            (state == State::BLACK ? mark_as_black : mark_as_white).insert(j);
+        }
+        return process(verbose, mark_as_black, mark_as_white, "Both colors of a guess agree.",
+            2 * rank, failed_cells);
+    }
+    if (i == 1) {
+        failed_cells.insert(index(x, y));
+    }
+
+    if (sr == SitRep::CONTRADICTION_FOUND) {
+        mark_as_diff.insert(index(x, y));
+        Logger::lg.warning("481 Hypothetical Contradiction found!");
+        return process(verbose, mark_as_black, mark_as_white, "Hypothetical contradiction!",
+            failed_guesses, failed_cells);
+
+    }
+    mark_as_same.insert(index(x, y));
+    Logger::lg.info("477 Hypothetical solution found!");
+    return process(verbose, mark_as_black, mark_as_white, "Hypothetical Solution!",
+        failed_guesses, failed_cells);
+}
+
+//A footprint only holds cells that were unknown when it was taken, so it is
+//unchanged while they all still are.
+bool Grid::all_unknown(std::vector<int> const& cells) const noexcept {
+    return std::all_of(cells.begin(), cells.end(), [this](int const i) { return m_states[i] == State::UNKNOWN; });
 }
 
 std::vector<std::pair<int, int>> Grid::guessing_order() {
@@ -522,86 +1109,536 @@ std::vector<std::pair<int, int>> Grid::guessing_order() {
     return ret;
 }
 
+//A nogood is a set of choices that cannot all hold, written as literals
+//2 * i + 1 for "cell i is black" and 2 * i for "cell i is white". The rules
+//do not say why they fired, so a nogood is simply the choices on the path to
+//a node whose subtree failed.
+struct Grid::Search {
+    steady_clock_tp deadline = steady_clock_tp::max();
+    //Whether propagate() refutes guesses too, as count_solutions() does at
+    //the root, until the deadline.
+    bool refute = false;
+    long long conflicts = 0;
+    long long conflict_limit = 0;
+    std::vector<int> decisions;
+    std::vector<std::vector<int>> nogoods;
+    std::vector<State> solution;
+};
+
+namespace {
+    constexpr int literal(int const i, bool const black) noexcept {
+        return 2 * i + (black ? 1 : 0);
+    }
+
+    //The Luby sequence 1, 1, 2, 1, 1, 2, 4, 1, ... for restart x, counted from 0.
+    long long luby(int x) {
+        long long size = 1;
+        int seq = 0;
+        while(size < x + 1) {
+            seq++;
+            size = 2 * size + 1;
+        }
+        while(size - 1 != x) {
+            size = (size - 1) / 2;
+            seq--;
+            x = static_cast<int>(x % size);
+        }
+        return 1LL << seq;
+    }
+
+    //Conflicts allowed before the first restart; later ones follow luby().
+    //A node costs a full run of the rules, so restarting every few dozen
+    //conflicts throws away more than a fresh start buys.
+    constexpr long long restart_conflicts = 512;
+}//end of namespace.
+
+Grid::SitRep Grid::search(steady_clock_tp const deadline, bool const verbose) {
+    if(m_sitRep == SitRep::CONTRADICTION_FOUND) {
+        return m_sitRep;
+    }
+    if(knownElements() == m_width * m_height) {
+        return solve(verbose);
+    }
+
+    //The search runs on a copy, so that only what it proves reaches the trace.
+    Grid work(*this);
+    Search s;
+    s.deadline = deadline;
+
+    SitRep result = SitRep::CANNOT_PROCEED;
+    for(int restart = 0; result == SitRep::CANNOT_PROCEED; restart++) {
+        if(restart > 0) {
+            if(std::chrono::steady_clock::now() >= deadline) {
+                break;
+            }
+            if constexpr(collect_stats) {
+                work.m_stats.search_restarts++;
+            }
+        }
+        s.conflicts = 0;
+        s.conflict_limit = restart_conflicts * luby(restart);
+        result = work.branch(s);
+    }
+    if constexpr(collect_stats) {
+        m_stats += work.m_stats;
+        m_stats.copies++;
+    }
+
+    //Between restarts the copy is back at its root, where everything it
+    //marked follows from this board.
+    std::vector<State> const& decided = result == SitRep::SOLUTION_FOUND ? s.solution : work.m_states;
+    CellSet mark_as_black(&m_arena);
+    CellSet mark_as_white(&m_arena);
+    for(int const i : m_unknowns) {
+        if(decided[i] == State::BLACK) {
+            mark_as_black.insert(i);
+        } else if(decided[i] == State::WHITE) {
+            mark_as_white.insert(i);
+        }
+    }
+
+    switch(result) {
+        case SitRep::SOLUTION_FOUND:
+            Logger::lg.info("Search found a solution after ", work.m_stats.search_conflicts, " conflicts");
+            static_cast<void>(process(verbose, mark_as_black, mark_as_white, "Search found a solution."));
+            return SitRep::SOLUTION_FOUND;
+
+        case SitRep::CONTRADICTION_FOUND:
+            Logger::lg.warning("Search found no solution");
+            write(Change::SITREP, 0, static_cast<int>(SitRep::CONTRADICTION_FOUND));
+            if(verbose) {
+                print("Search found no solution.");
+            }
+            return SitRep::CONTRADICTION_FOUND;
+
+        default:
+            Logger::lg.info("Search ran out of time");
+            static_cast<void>(process(verbose, mark_as_black, mark_as_white, "Search ran out of time."));
+            return SitRep::CANNOT_PROCEED;
+    }
+}
+
+//Runs the rules, without guessing, and the nogoods until neither decides
+//anything more, then the guesses that fail if the search asks for it. Past
+//the deadline it gives up between two steps of the rules.
+Grid::SitRep Grid::propagate(Search& s) {
+    for(;;) {
+        SitRep sr = m_sitRep == SitRep::CONTRADICTION_FOUND ? m_sitRep : SitRep::KEEP_GOING;
+        while(sr == SitRep::KEEP_GOING) {
+            if(std::chrono::steady_clock::now() >= s.deadline) {
+                return SitRep::CANNOT_PROCEED;
+            }
+            sr = solve(false, false);
+        }
+        if(m_sitRep == SitRep::CONTRADICTION_FOUND) {
+            return SitRep::CONTRADICTION_FOUND;
+        }
+        if(sr != SitRep::CANNOT_PROCEED) {
+            return sr;
+        }
+
+        //A nogood with all its literals true but one forces the last one false.
+        bool marked = false;
+        for(auto const& nogood : s.nogoods) {
+            int open = -1;
+            bool holds = true;
+            for(int const l : nogood) {
+                State const state = m_states[l / 2];
+                if(state == State::UNKNOWN && open < 0) {
+                    open = l;
+                } else if(state != (l % 2 == 1 ? State::BLACK : State::WHITE)) {
+                    holds = false;
+                    break;
+                }
+            }
+            if(!holds) {
+                continue;
+            }
+            if(open < 0) {
+                return SitRep::CONTRADICTION_FOUND;
+            }
+            auto const [ x, y ] = coords(open / 2);
+            mark(open % 2 == 1 ? State::WHITE : State::BLACK, x, y);
+            marked = true;
+            if(m_sitRep == SitRep::CONTRADICTION_FOUND) {
+                return SitRep::CONTRADICTION_FOUND;
+            }
+        }
+        if(!marked && !(s.refute && std::chrono::steady_clock::now() < s.deadline
+                        && analyze_hypotheticals(false, true, s.deadline))) {
+            return SitRep::CANNOT_PROCEED;
+        }
+    }
+}
+
+//Returns CONTRADICTION_FOUND when the subtree holds no solution, and
+//CANNOT_PROCEED when it is abandoned for a restart or the deadline.
+Grid::SitRep Grid::branch(Search& s) {
+    if constexpr(collect_stats) {
+        m_stats.search_nodes++;
+    }
+    SitRep const sr = propagate(s);
+    if(sr == SitRep::SOLUTION_FOUND) {
+        s.solution = m_states;
+    }
+    if(sr != SitRep::CANNOT_PROCEED) {
+        return sr;
+    }
+    if(s.conflicts >= s.conflict_limit || std::chrono::steady_clock::now() >= s.deadline) {
+        return SitRep::CANNOT_PROCEED;
+    }
+
+    auto const [ i, first ] = pick_branch();
+    auto const [ x, y ] = coords(i);
+    std::size_t const learned = s.nogoods.size();
+
+    for(State const color : { first, first == State::BLACK ? State::WHITE : State::BLACK }) {
+        std::size_t const cp = checkpoint();
+        s.decisions.push_back(literal(i, color == State::BLACK));
+        mark(color, x, y);
+
+        SitRep const result = branch(s);
+        rollback(cp);
+        if(result != SitRep::CONTRADICTION_FOUND) {
+            s.decisions.pop_back();
+            return result;
+        }
+
+        s.conflicts++;
+        if constexpr(collect_stats) {
+            m_stats.search_conflicts++;
+        }
+        s.nogoods.push_back(s.decisions);
+        s.decisions.pop_back();
+    }
+
+    //Both colors failed. The nogood the caller records for this node covers
+    //everything learned below it.
+    s.nogoods.resize(learned);
+    return SitRep::CONTRADICTION_FOUND;
+}
+
+//Fail first: a liberty of the unfinished region with the fewest of them, in
+//the region's own color, as growing it is the likelier way. Ties go to a
+//random region, so that restarts do not retrace the same path.
+std::pair<int, Grid::State> Grid::pick_branch() {
+    int best = -1;
+    int fewest = 0;
+    int ties = 0;
+    for(int const root : m_roots) {
+        Region const r(*this, root);
+        int const liberties = r.unk_size();
+        if(liberties == 0 || (r.is_numbered() && r.size() == r.its_number())) {
+            continue;
+        }
+        if(best < 0 || liberties < fewest) {
+            best = root;
+            fewest = liberties;
+            ties = 1;
+        } else if(liberties == fewest && std::uniform_int_distribution<int>(0, ties++)(m_eng) == 0) {
+            best = root;
+        }
+    }
+    if(best < 0) {
+        return { m_unknowns.front(), State::BLACK };
+    }
+    Region const r(*this, best);
+    return { *r.unk_begin(), r.is_black() ? State::BLACK : State::WHITE };
+}
+
+//Shared by the threads of count_solutions().
+struct Grid::Counter {
+    int limit = 0;
+    steady_clock_tp deadline;
+    std::atomic<int> found{0};
+    std::atomic<bool> timed_out{false};
+    std::mutex mutex;
+    std::vector<std::string> witnesses;
+
+    [[nodiscard]] bool done() const noexcept {
+        return found.load(std::memory_order_relaxed) >= limit || timed_out.load(std::memory_order_relaxed);
+    }
+
+    void add(std::string board) {
+        std::lock_guard lock{mutex};
+        if(found.load() < limit) {
+            found++;
+            if(witnesses.size() < 2) {
+                witnesses.push_back(std::move(board));
+            }
+        }
+    }
+};
+
+Grid::SolutionCount Grid::count_solutions(int const limit, steady_clock_tp const deadline) {
+    Counter c;
+    c.limit = std::max(1, limit);
+    c.deadline = deadline;
+
+    //The root refutes every guess it can first, as solve() would, so that a
+    //puzzle with one solution costs about as much to count as to solve. Deeper
+    //nodes only run the rules: where solutions abound, probing every node
+    //costs far more than the branches it saves.
+    Grid root(*this);
+    {
+        Search s;
+        s.deadline = deadline;
+        s.refute = true;
+        static_cast<void>(root.propagate(s));
+        if(std::chrono::steady_clock::now() >= deadline) {
+            c.timed_out = true;
+        }
+    }
+
+    //Split the tree breadth first, as paths of choices, until every thread
+    //has a few subtrees to take. A single thread takes the whole tree.
+    std::vector<std::vector<int>> frontier(1);
+    {
+        Search s;
+        s.deadline = deadline;
+        std::size_t const wanted = m_threads > 1 ? 4 * m_threads : 1;
+
+        while(!frontier.empty() && frontier.size() < wanted && !c.done()) {
+            std::vector<std::vector<int>> next;
+            for(auto const& path : frontier) {
+                if(std::chrono::steady_clock::now() >= c.deadline) {
+                    c.timed_out = true;
+                    break;
+                }
+                std::size_t const cp = root.checkpoint();
+                for(int const l : path) {
+                    auto const [ x, y ] = root.coords(l / 2);
+                    root.mark(l % 2 == 1 ? State::BLACK : State::WHITE, x, y);
+                }
+                SitRep const sr = root.propagate(s);
+                if(sr == SitRep::SOLUTION_FOUND) {
+                    c.add(root.board());
+                } else if(sr == SitRep::CANNOT_PROCEED) {
+                    auto const [ i, first ] = root.pick_branch();
+                    for(State const color : { first, first == State::BLACK ? State::WHITE : State::BLACK }) {
+                        next.push_back(path);
+                        next.back().push_back(literal(i, color == State::BLACK));
+                    }
+                }
+                root.rollback(cp);
+            }
+            frontier.swap(next);
+        }
+    }
+    if constexpr(collect_stats) {
+        m_stats += root.m_stats;
+        m_stats.copies++;
+    }
+
+    std::atomic<std::size_t> next_path{0};
+    ThreadPool::shared().run(m_threads, [&](unsigned) {
+        std::unique_ptr<Grid> other;
+        Search s;
+        s.deadline = deadline;
+
+        for(std::size_t k = next_path++; k < frontier.size() && !c.done(); k = next_path++) {
+            if(!other) {
+                other.reset(new Grid(root));
+            }
+            std::size_t const cp = other->checkpoint();
+            for(int const l : frontier[k]) {
+                auto const [ x, y ] = other->coords(l / 2);
+                other->mark(l % 2 == 1 ? State::BLACK : State::WHITE, x, y);
+            }
+            other->count_below(s, c);
+            other->rollback(cp);
+        }
+
+        if constexpr(collect_stats) {
+            if(other) {
+                std::lock_guard lock{mt};
+                m_stats += other->m_stats;
+                m_stats.copies++;
+            }
+        }
+    });
+
+    SolutionCount result;
+    result.solutions = c.found.load();
+    result.exhausted = !c.timed_out.load() && result.solutions < c.limit;
+    result.witnesses = std::move(c.witnesses);
+    return result;
+}
+
+void Grid::count_below(Search& s, Counter& c) {
+    if(c.done()) {
+        return;
+    }
+    if(std::chrono::steady_clock::now() >= c.deadline) {
+        c.timed_out = true;
+        return;
+    }
+    if constexpr(collect_stats) {
+        m_stats.search_nodes++;
+    }
+
+    SitRep const sr = propagate(s);
+    if(sr == SitRep::SOLUTION_FOUND) {
+        c.add(board());
+    }
+    if(sr != SitRep::CANNOT_PROCEED) {
+        return;
+    }
+
+    auto const [ i, first ] = pick_branch();
+    auto const [ x, y ] = coords(i);
+    for(State const color : { first, first == State::BLACK ? State::WHITE : State::BLACK }) {
+        std::size_t const cp = checkpoint();
+        mark(color, x, y);
+        count_below(s, c);
+        rollback(cp);
+        if(c.done()) {
+            return;
+        }
+    }
+}
+
 bool Grid::valid(int x, int y) {
     return x >= 0 && x < m_width && y >= 0 && y < m_height;
 }
 
+std::pair<int, int> Grid::coords(int i) const noexcept {
+    return std::make_pair(i % m_stride - 1, i / m_stride - 1);
+}
+
 Grid::State const& Grid::cell(int x, int y) const {
-    return m_cells[x][y].first;
+    return m_states[index(x, y)];
 }
 
 Grid::State& Grid::cell(int x, int y) {
-    return m_cells[x][y].first;
+    return m_states[index(x, y)];
 }
 
-std::shared_ptr<Grid::Region>& Grid::region(int x, int y) {
-    return m_cells[x][y].second;
+int Grid::find(int i) const noexcept {
+    assert(m_parent[i] >= 0);
+    while(m_parent[i] != i) {
+        if(m_checkpoints == 0) {
+            //Path halving.
+            m_parent[i] = m_parent[m_parent[i]];
+        }
+        i = m_parent[i];
+    }
+    return i;
 }
 
-std::shared_ptr<Grid::Region> const& Grid::region(int x, int y) const {
-    return m_cells[x][y].second;
+Grid::Region Grid::region(int x, int y) const {
+    int const i = index(x, y);
+    return m_parent[i] < 0 ? Region() : Region(*this, find(i));
 }
 
-void Grid::print(std::string_view s, set_pair_t const& updated, int failed_guesses, set_pair_t const& failed_coords) {
-
-    std::vector<std::vector<State>> v(m_width, std::vector<State>(m_height));
-
-    for(auto x = 0; x < m_width; x++) {
-        for(auto y = 0; y < m_height; y++) {
-            v[x][y] = cell(x, y);
-        }
+void Grid::print(std::string_view s, int failed_guesses, CellSet const& failed_cells) {
+    if(!m_trace.recording()) {
+        return;
     }
-    m_output.push_back(std::make_tuple(s, v, updated, std::chrono::steady_clock::now(), failed_guesses, failed_coords));
+    std::vector<int> failed;
+    failed.reserve(failed_cells.size());
+    for(int const i : failed_cells) {
+        auto const [ x, y ] = coords(i);
+        failed.push_back(x + y * m_width);
+    }
+    m_trace.step(s, failed_guesses, failed);
 }
 
-bool Grid::process(bool verbose, set_pair_t const& mark_as_black, set_pair_t const& mark_as_white, std::string_view s,
-    int const failed_guesses, set_pair_t const& failed_coords) {
+bool Grid::process(bool verbose, CellSet const& mark_as_black, CellSet const& mark_as_white, std::string_view s,
+    int const failed_guesses, CellSet const& failed_cells) {
 
     assert(s.data());
 
     if(mark_as_black.empty() && mark_as_white.empty()) {
         return false;
     }
-    for(auto const& [ x, y ] : mark_as_black){
+    for(int const i : mark_as_black){
+        auto const [ x, y ] = coords(i);
         mark(State::BLACK, x, y);
     }
-    for(auto const& [ x, y ] : mark_as_white){
+    for(int const i : mark_as_white){
+        auto const [ x, y ] = coords(i);
         mark(State::WHITE, x, y);
     }
     if(verbose) {
-        set_pair_t updated(mark_as_black);
-        updated.insert(mark_as_white.begin(), mark_as_white.end());
-
-        std::string_view t = s;
+        std::string t(s);
         if(m_sitRep == SitRep::CONTRADICTION_FOUND) {
-            t  = std::string(t) + std::string("Contradiction Found attempt to fuse two numbered region or mark marked cell.");
-            Logger::lg.msg("[WARNING] 591 Contradiction: mark known cell or attempt to fuse numbered regions.");
+            t += "Contradiction Found attempt to fuse two numbered region or mark marked cell.";
+            Logger::lg.warning("591 Contradiction: mark known cell or attempt to fuse numbered regions.");
         }
-        print(t, updated, failed_guesses, failed_coords);
+        print(t, failed_guesses, failed_cells);
     }
     return true;
 }
 
-void Grid::insert_valid_neighbors(set_pair_t& s, int x, int y) const { 
+void Grid::insert_valid_neighbors(CellSet& s, int x, int y) const { 
     for_valid_neighbors(x, y, [&](auto const a, auto const b) {
-        s.insert(std::make_pair(a, b));
+        s.insert(index(a, b));
     });
 }
 
-void Grid::insert_valid_unknown_neighbors(set_pair_t& s, int x, int y) const {
+void Grid::insert_valid_unknown_neighbors(CellSet& s, int x, int y) const {
     for_valid_neighbors(x, y, [&](auto const a, auto const b) {
         if(cell(a, b) == State::UNKNOWN) {
-            s.insert(std::make_pair(a, b));
+            s.insert(index(a, b));
         }
     });
 }
 
 void Grid::add_region(int x, int y) {
-    set_pair_t unknowns;
-    insert_valid_unknown_neighbors(unknowns, x, y);
-    auto r = std::make_shared<Grid::Region>(cell(x, y), std::move(unknowns), x, y);
-    region(x, y) = r;
-    m_regions.insert(std::move(r));
+    int const i = index(x, y);
+    assert(cell(x, y) != State::UNKNOWN);
+    assert(m_liberties[i].empty());
+
+    write(Change::PARENT, i, i);
+    write(Change::NEXT, i, i);
+    write(Change::SIZE, i, 1);
+    write(Change::KIND, i, static_cast<int>(cell(x, y)));
+
+    for_valid_neighbors(x, y, [&](auto const a, auto const b) {
+        if(cell(a, b) == State::UNKNOWN) {
+            m_liberties[i].insert(index(a, b));
+            record(Change::LIB_INSERT, index(a, b), i);
+        }
+    });
+
+    write(Change::ROOT_POS, i, static_cast<int>(m_roots.size()));
+    m_roots.push_back(i);
+    record(Change::ROOTS_PUSH, 0, 0);
+
+    touch(i);
+}
+
+void Grid::enqueue(Rule const rule, int const i) {
+    unsigned char const bit = 1 << rule;
+    if((m_queued[i] & bit) == 0) {
+        m_queued[i] |= bit;
+        m_dirty[rule].push_back(i);
+        record(Change::QUEUE_PUSH, i, rule);
+    }
+}
+
+void Grid::touch(int const i) {
+    enqueue(RULE_COMPLETE_ISLANDS, i);
+    enqueue(RULE_SINGLE_LIBERTY, i);
+    enqueue(RULE_DUAL_LIBERTIES, i);
+}
+
+//The queue keeps its capacity, as enqueue() refills it right away.
+std::pmr::vector<int> Grid::take_dirty(Rule const rule) {
+    std::pmr::vector<int> taken(m_dirty[rule].begin(), m_dirty[rule].end(), &m_arena);
+    m_dirty[rule].clear();
+    for(int const i : taken) {
+        m_queued[i] &= ~(1 << rule);
+        record(Change::QUEUE_TAKE, i, rule);
+    }
+    //Regions may have fused since their cells were queued.
+    for(int& i : taken) {
+        i = find(i);
+    }
+    std::sort(taken.begin(), taken.end());
+    taken.erase(std::unique(taken.begin(), taken.end()), taken.end());
+    return taken;
 }
 
 void Grid::mark(State const state, int x, int y) {
@@ -610,126 +1647,334 @@ void Grid::mark(State const state, int x, int y) {
     }
 
     if(cell(x, y) != State::UNKNOWN) {
-        m_sitRep = SitRep::CONTRADICTION_FOUND;
-        Logger::lg.msg("[WARNING] 622 Found contradiction!");
+        write(Change::SITREP, 0, static_cast<int>(SitRep::CONTRADICTION_FOUND));
+        Logger::lg.warning("622 Found contradiction!");
         return;
     }
-    cell(x, y) = state;
-    for(auto const& sp : m_regions) {
-        sp->unk_erase(x, y);
+    int const i = index(x, y);
+    write(Change::STATE, i, static_cast<int>(state));
+    m_epoch++;
+
+    int const pos = m_unknown_pos[i];
+    int const last = m_unknowns.back();
+    write(Change::UNKNOWNS, pos, last);
+    write(Change::UNKNOWN_POS, last, pos);
+    m_unknowns.pop_back();
+    record(Change::UNKNOWNS_POP, 0, last);
+    write(Change::UNKNOWN_POS, i, -1);
+
+    for(auto const& [ root, generation ] : m_watchers[i]) {
+        if(m_footprints[root].generation == generation) {
+            drop_footprint(root);
+        }
+    }
+    //Outside a checkpoint no dropped footprint can come back.
+    if(m_checkpoints == 0) {
+        m_watchers[i].clear();
     }
+
+    //Liberties are the unknown cells next to a region, so only the regions
+    //of the cell's neighbors can lose it.
+    for_valid_neighbors(x, y, [this, i](auto const a, auto const b) {
+        if(Region const r = region(a, b); r && m_liberties[r.root()].erase(i) > 0) {
+            record(Change::LIB_ERASE, i, r.root());
+        }
+    });
     add_region(x, y); 
     for_valid_neighbors(x, y, [this, x, y](auto const a, auto const b) {
         fuse_regions((region(x, y)), region(a, b));
     });
 
+    //Neighboring regions either grew or lost a liberty.
+    for_valid_neighbors(x, y, [this](auto const a, auto const b) {
+        if(Region const r = region(a, b)) {
+            touch(r.root());
+        }
+    });
 }
 
-void Grid::fuse_regions(std::shared_ptr<Region> r1, std::shared_ptr<Region> r2) {
+void Grid::fuse_regions(Region const r1, Region const r2) {
 
     if(!r1 || !r2 || r1 == r2) {
         return;
     }
-    if(r1->is_numbered() && r2->is_numbered()) {
-        m_sitRep = SitRep::CONTRADICTION_FOUND;
+    if(r1.is_numbered() && r2.is_numbered()) {
+        write(Change::SITREP, 0, static_cast<int>(SitRep::CONTRADICTION_FOUND));
         return;
     }
-    if (r1->is_black() != r2->is_black()) {
+    if (r1.is_black() != r2.is_black()) {
         return;
     }
-    if(r2->size() > r1->size()) {
-        swap(r1, r2);
+    State const kind = r2.is_numbered() ? m_kind[r2.root()] : m_kind[r1.root()];
+    drop_footprint(r1.root());
+    drop_footprint(r2.root());
+
+    //Union by size: the smaller tree hangs below the larger root.
+    int big = r1.root();
+    int small = r2.root();
+    if(m_size[small] > m_size[big]) {
+        std::swap(big, small);
     }
-    if(r2->is_numbered()) {
-        swap(r1, r2);
+    write(Change::PARENT, small, big);
+    write(Change::SIZE, big, m_size[big] + m_size[small]);
+    write(Change::KIND, big, static_cast<int>(kind));
+
+    //Splice the two circular member lists.
+    int const next_big = m_next[big];
+    write(Change::NEXT, big, m_next[small]);
+    write(Change::NEXT, small, next_big);
+
+    //Merge the smaller liberty set into the larger one.
+    if(m_liberties[big].size() < m_liberties[small].size()) {
+        m_liberties[big].swap(m_liberties[small]);
+        record(Change::LIB_SWAP, small, big);
     }
-    r1->insert(r2->begin(), r2->end());
-    r1->unk_insert(r2->unk_begin(), r2->unk_end());
-
-    for(auto const& [ x, y ] : *r2) {
-        region(x, y) = r1;
+    for(int const i : m_liberties[small]) {
+        if(m_liberties[big].insert(i)) {
+            record(Change::LIB_INSERT, i, big);
+        }
+        record(Change::LIB_ERASE, i, small);
     }
-    m_regions.erase(r2);
+    m_liberties[small].clear();
+
+    int const pos = m_root_pos[small];
+    int const last = m_roots.back();
+    write(Change::ROOTS, pos, last);
+    write(Change::ROOT_POS, last, pos);
+    m_roots.pop_back();
+    record(Change::ROOTS_POP, 0, last);
+    write(Change::ROOT_POS, small, -1);
+}
 
+std::size_t Grid::checkpoint() {
+    m_checkpoints++;
+    return m_trail.size();
 }
 
-bool Grid::impossibly_big_white_region(int n) const { 
-    return std::none_of(m_regions.begin(), m_regions.end(), [n](std::shared_ptr<Region> const& sp) {
-        return sp->is_numbered() && sp->size() + n + 1 <= sp->its_number();
-    });
+void Grid::rollback(std::size_t const checkpoint) {
+    assert(m_checkpoints > 0 && checkpoint <= m_trail.size());
+    while(m_trail.size() > checkpoint) {
+        undo(m_trail.back());
+        m_trail.pop_back();
+    }
+    m_checkpoints--;
+    m_epoch++;
 }
 
-//this should be parallelised .
-bool Grid::unreachable(int x_root, int y_root, set_pair_t discovered) {
+void Grid::write(Change::Kind const kind, int const i, int const value) {
+    int old = 0;
+    switch(kind) {
+        case Change::STATE:     old = static_cast<int>(m_states[i]);    m_states[i] = static_cast<State>(value);
+                                set_bits(i, m_states[i]);
+                                if(m_trace.recording() && m_checkpoints == 0) {
+                                    auto const [ x, y ] = coords(i);
+                                    m_trace.change(x + y * m_width, value);
+                                }                                                                         break;
+        case Change::KIND:      old = static_cast<int>(m_kind[i]);      m_kind[i] = static_cast<State>(value);    break;
+        case Change::PARENT:    old = m_parent[i];                      m_parent[i] = value;                      break;
+        case Change::NEXT:      old = m_next[i];                        m_next[i] = value;                        break;
+        case Change::SIZE:      old = m_size[i];                        m_size[i] = value;                        break;
+        case Change::ROOT_POS:  old = m_root_pos[i];                    m_root_pos[i] = value;                    break;
+        case Change::ROOTS:     old = m_roots[i];                       m_roots[i] = value;                       break;
+        case Change::UNKNOWNS:  old = m_unknowns[i];                    m_unknowns[i] = value;                    break;
+        case Change::UNKNOWN_POS: old = m_unknown_pos[i];               m_unknown_pos[i] = value;                 break;
+        case Change::SITREP:    old = static_cast<int>(m_sitRep);       m_sitRep = static_cast<SitRep>(value);    break;
+        default:
+            assert(false && "Grid::write()- not a plain write");
+    }
+    record(kind, i, old);
+}
 
-    if(cell(x_root, y_root) != State::UNKNOWN) {
-        return false;
+void Grid::record(Change::Kind const kind, int const i, int const value) {
+    if(m_checkpoints > 0) {
+        m_trail.push_back(Change{kind, i, value});
     }
-    std::queue<std::tuple<int, int, int>> q;
-    q.push(std::make_tuple(x_root, y_root, 1));
-        
-    while(!q.empty()) {
+}
 
-        auto [ x_curr, y_curr, n_curr ] = q.front();
-        q.pop();
+void Grid::undo(Change const& change) {
+    auto const [ kind, i, value ] = change;
+    switch(kind) {
+        case Change::STATE:         m_states[i] = static_cast<State>(value);
+                                    set_bits(i, m_states[i]);                  break;
+        case Change::KIND:          m_kind[i] = static_cast<State>(value);     break;
+        case Change::PARENT:        m_parent[i] = value;                       break;
+        case Change::NEXT:          m_next[i] = value;                         break;
+        case Change::SIZE:          m_size[i] = value;                         break;
+        case Change::ROOT_POS:      m_root_pos[i] = value;                     break;
+        case Change::ROOTS:         m_roots[i] = value;                        break;
+        case Change::ROOTS_PUSH:    m_roots.pop_back();                        break;
+        case Change::ROOTS_POP:     m_roots.push_back(value);                  break;
+        case Change::UNKNOWNS:      m_unknowns[i] = value;                     break;
+        case Change::UNKNOWN_POS:   m_unknown_pos[i] = value;                  break;
+        case Change::UNKNOWNS_POP:  m_unknowns.push_back(value);               break;
+        case Change::QUEUE_PUSH: {
+            auto& q = m_dirty[value];
+            q.erase(std::find(q.begin(), q.end(), i));
+            m_queued[i] &= ~(1 << value);
+            break;
+        }
+        case Change::QUEUE_TAKE:
+            m_dirty[value].push_back(i);
+            m_queued[i] |= 1 << value;
+            break;
+        case Change::LIB_INSERT:    m_liberties[value].erase(i);               break;
+        case Change::LIB_ERASE:     m_liberties[value].insert(i);              break;
+        case Change::LIB_SWAP:      m_liberties[value].swap(m_liberties[i]);   break;
+        case Change::FOOTPRINT:
+            m_footprints[i] = std::move(m_footprint_saved.back());
+            m_footprint_saved.pop_back();
+            break;
+        case Change::FOOTPRINT_DROP: m_footprints[i].valid = true;             break;
+        case Change::WATCH:         m_watchers[i].pop_back();                  break;
+        case Change::SITREP:        m_sitRep = static_cast<SitRep>(value);     break;
+    }
+}
 
-        std::set<std::shared_ptr<Region>> white_region;
-        std::set<std::shared_ptr<Region>> numbered_region;
+void Grid::set_bits(int const i, State const state) {
+    auto const [ x, y ] = coords(i);
+    m_black.reset(x, y);
+    m_white.reset(x, y);
+    m_unknown.reset(x, y);
+    if(state == State::BLACK) {
+        m_black.set(x, y);
+    } else if(state == State::UNKNOWN) {
+        m_unknown.set(x, y);
+    } else {
+        m_white.set(x, y);
+    }
+}
 
-        for_valid_neighbors(x_curr, y_curr, [&](auto const a, auto const b){
-            std::shared_ptr<Region> const& r = region(a, b);
-            if(r && r->is_white()){
-                Logger::lg.msg("[INFO] 705 collecting the white neighbors.");
-                white_region.insert(r);
-                    
-            } else if (r && r->is_numbered()) {
-                Logger::lg.msg("[INFO] 705 collecting the numbered neighbors.");
-                numbered_region.insert(r);
-            }
-        });
+bool Grid::impossibly_big_white_region(int n) const { 
+    return std::none_of(m_roots.begin(), m_roots.end(), [this, n](int const root) {
+        Region const r(*this, root);
+        return r.is_numbered() && r.size() + n + 1 <= r.its_number();
+    });
+}
 
-        size_t size = 0;
-            
-        for (auto const& sp : white_region) {
-                size += sp->size();        
+void Grid::compute_reach() {
+    if(m_reach_epoch != m_epoch) {
+        compute_reach(-1, m_reach, m_reach_from);
+        m_reach_epoch = m_epoch;
+    } else if constexpr (collect_stats) {
+        m_stats.reach_hits++;
+    }
+}
+
+//One multi-source pass from every numbered island at once, replacing a
+//separate search per cell. Labels are the island's remaining budget and are
+//settled from the largest down, so each cell keeps the best one.
+//Entering an unknown cell costs the cell itself plus every white region next
+//to it, as the island would have to swallow those too, except the regions
+//already paid for next to the cell it came from. Walking through an already
+//paid for white region is free. A cell next to a numbered region may only be
+//entered by that region's island, and one next to two never. The `blocked`
+//cell, if any, is treated as black.
+void Grid::compute_reach(int const blocked, std::vector<int>& reach, std::vector<int>& from) {
+    PhaseTimer const timer{*this, PHASE_COMPUTE_REACH};
+    if constexpr (collect_stats) {
+        m_stats.reach_misses++;
+    }
+    std::fill(reach.begin(), reach.end(), -1);
+
+    auto const label = [&](int const i, int const budget, int const owner, int const source) {
+        reach[i] = budget;
+        from[i] = source;
+        m_reach_owner[i] = owner;
+        if(m_reach_buckets.size() <= static_cast<std::size_t>(budget)) {
+            m_reach_buckets.resize(budget + 1);
         }
-        for (auto const& sp : numbered_region) {
-                size += sp->size();          
-        } 
-        if (numbered_region.size() > 1) {
-            Logger::lg.msg("[INFO] size > 1");
-            continue;
+        m_reach_buckets[budget].push_back(i);
+    };
+    auto const root_or_none = [this](int const i) {
+        return m_parent[i] < 0 ? -1 : find(i);
+    };
+
+    int top = -1;
+    for(int const root : m_roots) {
+        Region const r(*this, root);
+        if(r.is_numbered() && r.size() <= r.its_number()) {
+            int const budget = r.its_number() - r.size();
+            for(auto const& [ x, y ] : r) {
+                label(index(x, y), budget, root, -1);
+            }
+            top = std::max(top, budget);
         }
-        if(numbered_region.size() == 1) {
-            int const num = (*numbered_region.begin())->its_number();
-            if(n_curr + size <= num) {
-                Logger::lg.msg("[INFO] size <= 1");
-                return false;
+    }
 
-            } else {
-                Logger::lg.msg("[INFO] size > 1");
+    for(int budget = top; budget >= 0; budget--) {
+        //Free moves append to the bucket being walked, so walk it by index.
+        auto& bucket = m_reach_buckets[budget];
+        for(std::size_t k = 0; k < bucket.size(); k++) {
+            int const c = bucket[k];
+            if(reach[c] != budget) {
                 continue;
             }
-        } 
-        if(!white_region.empty()) {
-            if(impossibly_big_white_region(n_curr + size)) {
-                Logger::lg.msg("[INFO] 764 impossibly big white region");
-                continue;
+            int const owner = m_reach_owner[c];
+            std::array<int, 5> const paid{ { root_or_none(c), root_or_none(c - 1), root_or_none(c + 1),
+                root_or_none(c - m_stride), root_or_none(c + m_stride) } };
 
-            } else {
-                return false;
+            for(int const d : { c - 1, c + 1, c - m_stride, c + m_stride }) {
+                if(d == blocked) {
+                    continue;
+                }
+                if(m_states[d] == State::UNKNOWN) {
+                    int cost = 1;
+                    std::array<int, 4> seen{};
+                    auto seen_end = seen.begin();
+                    bool blocked_by_island = false;
+
+                    for(int const e : { d - 1, d + 1, d - m_stride, d + m_stride }) {
+                        int const root = root_or_none(e);
+                        if(root < 0 || std::find(seen.begin(), seen_end, root) != seen_end) {
+                            continue;
+                        }
+                        *seen_end++ = root;
+
+                        Region const w(*this, root);
+                        if(w.is_numbered()) {
+                            blocked_by_island |= root != owner;
+                        } else if(w.is_white() && std::find(paid.begin(), paid.end(), root) == paid.end()) {
+                            cost += w.size();
+                        }
+                    }
+                    if(!blocked_by_island && budget - cost > reach[d]) {
+                        label(d, budget - cost, owner, c);
+                    }
+
+                } else if(m_states[d] == State::WHITE && budget > reach[d]) {
+                    Region const w(*this, find(d));
+                    if(!w.is_numbered()) {
+                        for(auto const& [ x, y ] : w) {
+                            label(index(x, y), budget, owner, c);
+                        }
+                    }
+                }
             }
         }
-        for_valid_neighbors(x_curr, y_curr, [&](auto const a, auto const b){
-            if(cell(a, b) == State::UNKNOWN && discovered.insert(std::make_pair(a, b)).second) {
-                Logger::lg.msg("[INFO] 773 the new neighbors are taken");
-                q.push(std::make_tuple(a, b, n_curr + 1));
-            }
-        });
-          
+    }
+    for(auto& bucket : m_reach_buckets) {
+        bucket.clear();
+    }
+}
 
+//Whether cell i could still be reached by an island if cell `blocked` were
+//black. Blackening a cell never helps, so if the path that gave i its label
+//avoids `blocked` the label stands; only otherwise is the field recomputed.
+bool Grid::reachable_without(int const i, int const blocked) {
+    compute_reach();
+
+    if(m_reach[i] < 0) {
+        return false;
     }
-    return true;
+    int c = i;
+    while(c >= 0 && c != blocked) {
+        c = m_reach_from[c];
+    }
+    if(c < 0) {
+        return true;
+    }
+    compute_reach(blocked, m_blocked_reach, m_blocked_from);
+    return m_blocked_reach[i] >= 0;
 }
 
 namespace {
@@ -738,198 +1983,286 @@ namespace {
         OPEN, 
         CLOSED, 
         VERBOTEN,
+        REJECTED,
     };
 
-}//end of namespace.
+    //Scratch space for Grid::confined(), one per thread. A flag only counts
+    //while its stamp matches the current generation, so a new search starts
+    //by bumping the generation instead of clearing the board.
+    struct ConfinedScratch {
+        std::vector<unsigned> stamps;
+        std::vector<Flag> flags;
+        std::vector<int> frontier;
+        std::vector<int> consumed;
+        std::vector<int> watched;
+        unsigned generation = 0;
+
+        void reset(std::size_t const size) {
+            if(stamps.size() < size) {
+                stamps.assign(size, 0);
+                flags.resize(size);
+                generation = 0;
+            }
+            if(++generation == 0) {
+                std::fill(stamps.begin(), stamps.end(), 0);
+                generation = 1;
+            }
+            frontier.clear();
+            consumed.clear();
+            watched.clear();
+        }
+        Flag get(int const i) const noexcept {
+            return stamps[i] == generation ? flags[i] : NONE;
+        }
+        void set(int const i, Flag const f) noexcept {
+            stamps[i] = generation;
+            flags[i] = f;
+        }
+    };
 
-bool Grid::confined(std::shared_ptr<Region> const& r, cache_map_t& cache, set_pair_t const& verboten) {
+    thread_local ConfinedScratch confined_scratch;
 
-    if (!verboten.empty()) {
-        auto const i = cache.find(r);
+}//end of namespace.
 
-        if (i == cache.end()) {
-            return false;
-        }
+bool Grid::confined(Region const r, CellSet const& verboten) {
+    PhaseTimer const timer{*this, PHASE_CONFINED};
 
-        auto const& consumed = i->second;
-        if (std::none_of(verboten.begin(), verboten.end(), [&](auto const& p) {
-            return consumed.find(p) != consumed.end();
-            })) {
+    Footprint& footprint = m_footprints[r.root()];
+    if constexpr (collect_stats) {
+        (footprint.valid ? m_stats.footprint_hits : m_stats.footprint_misses)++;
+    }
+    if (!footprint.valid) {
+        bool const result = search_confined(r, {}, true);
+        auto& scratch = confined_scratch;
 
-            return false;
+        if (m_checkpoints > 0) {
+            m_footprint_saved.push_back(std::move(footprint));
+            record(Change::FOOTPRINT, r.root(), 0);
+        }
+        footprint.generation = ++m_footprint_generation;
+        footprint.valid = true;
+        footprint.confined = result;
+        footprint.consumed = CellSet(scratch.consumed.begin(), scratch.consumed.end());
+
+        for (int const i : scratch.watched) {
+            auto& watchers = m_watchers[i];
+            if (m_checkpoints == 0) {
+                watchers.erase(std::remove_if(watchers.begin(), watchers.end(), [this](auto const& w) {
+                    return m_footprints[w.first].generation != w.second || !m_footprints[w.first].valid;
+                    }), watchers.end());
+            }
+            watchers.emplace_back(r.root(), footprint.generation);
+            record(Change::WATCH, i, 0);
         }
     }
-    std::vector<Flag> flags(m_width * m_height, NONE);
 
-    for(auto i{r->unk_begin()}; i != r->unk_end(); ++i) {
-        auto const& [ x, y ] = *i;
-        flags[x + y * m_width] = OPEN;
+    if (verboten.empty()) {
+        return footprint.confined;
     }
 
-    for(auto const& [ x, y ] : *r) {
-        flags[x + y * m_width] = CLOSED;
+    //A search that never consumed a forbidden cell runs the same with it forbidden.
+    auto const& consumed = footprint.consumed;
+    if (std::none_of(verboten.begin(), verboten.end(), [&](int const i) {
+        return consumed.contains(i);
+        })) {
+
+        return false;
     }
+    return search_confined(r, verboten, false);
+}
 
-    int closed_size = r->size();
+void Grid::drop_footprint(int const root) {
+    if (m_footprints[root].valid) {
+        m_footprints[root].valid = false;
+        record(Change::FOOTPRINT_DROP, root, 0);
+    }
+}
 
-    for(auto const& [ x, y ] : verboten) {
-        flags[x + y * m_width] = VERBOTEN;
+//With remember set, the unknown cells the search consumed and every cell whose
+//state it depended on are left in the scratch for confined() to cache.
+//The search runs on cell indices alone. The board widths we see most get a
+//row stride known at compile time, which the compiler folds into the
+//neighbor offsets; other widths read m_stride.
+bool Grid::search_confined(Region const r, CellSet const& verboten, bool const remember) {
+    switch (m_stride) {
+        case 10 + 2: return search_confined<10 + 2>(r, verboten, remember);
+        case 20 + 2: return search_confined<20 + 2>(r, verboten, remember);
+        case 36 + 2: return search_confined<36 + 2>(r, verboten, remember);
+        case 50 + 2: return search_confined<50 + 2>(r, verboten, remember);
+        default:     return search_confined<0>(r, verboten, remember);
     }
+}
 
-    while ((r->is_black() && closed_size < m_total_black)
-        || r->is_white()
-        || (r->is_numbered() && closed_size < r->is_numbered())) {
+template <int Stride>
+bool Grid::search_confined(Region const r, CellSet const& verboten, bool const remember) {
+    int const stride = Stride > 0 ? Stride : m_stride;
+    std::array<int, 4> const offsets{ { -1, 1, -stride, stride } };
 
-        auto const iter = std::find(flags.begin(), flags.end(), OPEN);
-        if (iter == flags.end()) {
-            break;
+    auto& scratch = confined_scratch;
+    scratch.reset(m_states.size());
+
+    auto const for_neighbors = [&](int const i, auto f) {
+        for (int const d : offsets) {
+            if (m_states[i + d] != State::BORDER) {
+                f(i + d);
+            }
         }
-        *iter = NONE;
-        size_t index = static_cast<size_t>(iter - flags.begin());
+    };
+    auto const region_at = [this](int const i) {
+        return m_parent[i] < 0 ? Region() : Region(*this, find(i));
+    };
+    auto const close = [&](Region const area) {
+        int i = area.root();
+        do {
+            scratch.set(i, CLOSED);
+            i = m_next[i];
+        } while (i != area.root());
+    };
 
-        const std::pair<int, int> p(index % m_width, index / m_width);
-        const auto& area = region(p.first, p.second);
-        if (r->is_black()) {
-            if (!area) {
+    auto const watch = [&](int const i) {
+        if (remember) {
+            scratch.watched.push_back(i);
+        }
+    };
+    auto const open = [&](int const i) {
+        if (scratch.get(i) == NONE) {
+            scratch.set(i, OPEN);
+            scratch.frontier.push_back(i);
+            watch(i);
+        }
+    };
 
-            }
-            else if (area->is_black()) {
+    for(auto i{r->unk_begin()}; i != r->unk_end(); ++i) {
+        open(*i);
+    }
 
-            }
-            else {
-                continue;
-            }
+    close(r);
+
+    int closed_size = r->size();
+
+    for(int const i : verboten) {
+        scratch.set(i, VERBOTEN);
+    }
+
+    int const target = r->is_black() ? m_total_black : r->is_numbered() ? r->its_number() : 0;
+    auto const short_of_target = [&] {
+        return r->is_white() || closed_size < target;
+    };
+
+    while (short_of_target() && !scratch.frontier.empty()) {
 
+        int const i = scratch.frontier.back();
+        scratch.frontier.pop_back();
+        if (scratch.get(i) != OPEN) {
+            continue;
         }
-        else if (r->is_white()) {
-            if (!area) {
 
-            }
-            else if (area->is_black()) {
-                continue;
-            }
-            else if (area->is_white()) {
+        Region const area = region_at(i);
+        bool rejected = false;
 
-            }
-            else {
+        if (r->is_black()) {
+            rejected = area && !area->is_black();
+        }
+        else if (r->is_white()) {
+            if (area && area->is_numbered()) {
                 return false;
             }
+            rejected = area && area->is_black();
         }
         else {
             if (!area) {
-
-                bool rejected = false;
-
-                for_valid_neighbors(p.first, p.second, [&](auto const a, auto const b) {
-                    auto const& other = region(a, b);
+                for_neighbors(i, [&](int const j) {
+                    Region const other = region_at(j);
                     if (other && other->is_numbered() && other != r) {
                         rejected = true;
                     }
+                    //A plain white neighbor turns numbered by growing into one of its liberties.
+                    watch(j);
+                    if (remember && other && other->is_white()) {
+                        for (auto k = other->unk_begin(); k != other->unk_end(); ++k) {
+                            watch(*k);
+                        }
+                    }
                     });
-
-                if (rejected) {
-                    continue;
-                }
             }
             else if (area->is_black()) {
-                continue;
-            }
-            else if (area->is_white()) {
-
+                rejected = true;
             }
             else {
-                assert(false && "Grid::confined()- i was confused and thought "
+                assert(area->is_white() && "Grid::confined()- i was confused and thought "
                     "two numbered region would be adjacent");
             }
         }
 
+        if (rejected) {
+            scratch.set(i, REJECTED);
+            continue;
+        }
 
         if (!area) {
-            flags[p.first + p.second * m_width] = CLOSED;
+            scratch.set(i, CLOSED);
             ++closed_size;
 
-            for_valid_neighbors(p.first, p.second, [&](auto const a, auto const b) {
-                Flag& f = flags[a + b * m_width];
-                if (f == NONE) {
-                    f = OPEN;
-                }
-                });
+            for_neighbors(i, open);
 
-            if (verboten.empty()) {
-                cache[r].insert(p);
+            if (remember) {
+                scratch.consumed.push_back(i);
             }
         }
         else {
-            for (auto const& [x, y] : *area) {
-                flags[x + y * m_width] = CLOSED;
-            }
+            close(area);
             closed_size += area->size();
-            for (auto i = area->unk_begin(); i != area->unk_end(); ++i) {
-                auto const& [x, y] = *i;
-                Flag& f = flags[x + y * m_width];
-
-                if (f == NONE) {
-                    f = OPEN;
-                }
+            for (auto j = area->unk_begin(); j != area->unk_end(); ++j) {
+                open(*j);
             }
         }
     }
 
-    return(r->is_black() && closed_size < m_total_black) || r->is_white() || (r->is_numbered() && closed_size < r->is_numbered());
+    return short_of_target();
 }
 
-bool Grid::detect_contradictions(bool verbose, cache_map_t& cache) {
+bool Grid::detect_contradictions(bool verbose) {
+    PhaseTimer const timer{*this, PHASE_CONTRADICTIONS};
 
     auto uh_oh = [&](std::string const& s)->bool {
         if (verbose) {
             print(s);
         }
-        m_sitRep = SitRep::CONTRADICTION_FOUND;
+        write(Change::SITREP, 0, static_cast<int>(SitRep::CONTRADICTION_FOUND));
         return true;
     };
-    for(auto x = 0; x < m_width - 1; ++x) {
-        for(auto y = 0; y < m_height - 1; ++y) {
-            if(cell(x, y) == State::BLACK
-            && cell(x + 1, y) == State::BLACK
-            && cell(x, y + 1) == State::BLACK
-            && cell(x + 1, y + 1) == State::BLACK) {
-
-                Logger::lg.msg("[WARNING] 919 Contradiction pool detected.");
-                return uh_oh("Contradiction found! Pool detected.");
-                    
-                
-
-            }
-        }
+    if(any_pool(m_black)) {
+        Logger::lg.warning("919 Contradiction pool detected.");
+        return uh_oh("Contradiction found! Pool detected.");
     }
     int black_cells = 0;
     int white_cells = 0;
-    for(const auto& sp : m_regions) {
-        const Region& r = *sp;
+    for(int const root : m_roots) {
+        Region const r(*this, root);
 
         if((r.is_white() && impossibly_big_white_region(r.size()))
             || (r.is_numbered() && r.size() > r.its_number())) {
 
-            Logger::lg.msg("[WARNING] 928 Gigantic region detected");
+            Logger::lg.warning("928 Gigantic region detected");
             return  uh_oh("Contradiction! Gigantic region detected.");
 
         }
 
         (r.is_black() ? black_cells : white_cells) += r.size();
 
-        if(confined(sp, cache)) {
-            Logger::lg.msg("[WARNING] 936 Confined region");
+        if(confined(r)) {
+            Logger::lg.warning("936 Confined region");
             return uh_oh("Contradiction! confined region found.");
 
 
         }
         if(black_cells > m_total_black) {
-            Logger::lg.msg("[WARNING] 942 Too many black cells");
+            Logger::lg.warning("942 Too many black cells");
             return uh_oh("Contradiction! Too many black cells.");
 
         }
         if(white_cells > m_width * m_height - m_total_black) {
-            Logger::lg.msg("[WARNING] 918 Many numbered/white cells found");
+            Logger::lg.warning("918 Many numbered/white cells found");
             return uh_oh("Contradiction! Too many white/numbered cells found.");
 
         }
@@ -950,19 +2283,47 @@ std::string format_time(Grid::steady_clock_tp const start, Grid::steady_clock_tp
 Grid::Grid(Grid const& other) 
     : m_width(other.m_width),
     m_height(other.m_height),
+    m_stride(other.m_stride),
+    m_threads(other.m_threads),
     m_total_black(other.m_total_black),
-    m_cells(other.m_cells),
-    m_regions(),
+    m_states(other.m_states),
+    m_parent(other.m_parent),
+    m_next(other.m_next),
+    m_size(other.m_size),
+    m_kind(other.m_kind),
+    m_liberties(other.m_liberties),
     m_sitRep(other.m_sitRep),
-    m_eng(other.m_eng) {
-
-        for(auto const& sp : other.m_regions) {
-            m_regions.insert(std::make_shared<Region>(*sp));
-        }
-
-        for(auto const& sp : m_regions) {
-            for(auto const& [ x, y ] : *sp) {
-                region(x, y) = sp;
-            }
-        }
+    m_roots(other.m_roots),
+    m_root_pos(other.m_root_pos),
+    m_unknowns(other.m_unknowns),
+    m_unknown_pos(other.m_unknown_pos),
+    m_dirty(other.m_dirty),
+    m_queued(other.m_queued),
+    m_black(other.m_black),
+    m_white(other.m_white),
+    m_unknown(other.m_unknown),
+    m_reach(other.m_reach),
+    m_reach_from(other.m_reach_from),
+    m_reach_owner(other.m_reach_owner),
+    m_blocked_reach(other.m_blocked_reach),
+    m_blocked_from(other.m_blocked_from),
+    m_reach_buckets(),
+    m_reach_epoch(0),
+    m_epoch(1),
+    m_footprints(other.m_footprints),
+    m_footprint_saved(),
+    m_watchers(other.m_watchers),
+    m_footprint_generation(other.m_footprint_generation),
+    m_probes(),
+    m_probing(other.m_probing),
+    m_local_skip(0),
+    m_local_backoff(0),
+    m_timing(other.m_timing),
+    m_stats(),
+    m_trace(),
+    m_eng(other.m_eng),
+    m_trail(),
+    m_checkpoints(0),
+    m_arena_buffer(arena_size),
+    m_arena(m_arena_buffer.data(), m_arena_buffer.size()) {
 }
@@ -1,27 +1,37 @@
 #pragma once
 
+#include "Bitboard.hpp"
+#include "CellSet.hpp"
+#include "Trace.hpp"
+
 #include <string>
+#include <array>
 #include <chrono>
 #include <string_view>
 #include <memory>
+#include <memory_resource>
 #include <vector>
 #include <utility>
 #include <random>
-#include <set>
-#include <map>
 #include <string>
-#include <regex>
 #include <thread>
 #include <mutex>
 
 
 class Grid {
 public:
-    using steady_clock_tp = std::chrono::high_resolution_clock::time_point;
-    using set_pair_t = std::set<std::pair<int, int>>;
+    using steady_clock_tp = std::chrono::steady_clock::time_point;
 
+    //The plain format: a run of digits is a numbered cell, a space an empty
+    //one, and line breaks are ignored.
     Grid(int width, int height, std::string_view s);
 
+    //The compact format puts a puzzle on one line: "WxH:" and then the cells
+    //row by row. A run of digits is a numbered cell, '.' an empty one, a letter
+    //a..z a run of 1..26 empty cells, and ',' separates two numbers that would
+    //otherwise run together across a row break. "3x2:2d1" is "2  " over "  1".
+    explicit Grid(std::string_view compact);
+
     enum struct SitRep {
         CONTRADICTION_FOUND,
         SOLUTION_FOUND,
@@ -29,121 +39,466 @@ public:
         CANNOT_PROCEED,
     };
 
-    SitRep solve(bool verbose = true, bool guessing = true);
+    //Takes one step of the rules. No guess starts after the deadline.
+    SitRep solve(bool verbose = true, bool guessing = true,
+                 steady_clock_tp deadline = steady_clock_tp::max());
+
+    //Settles what solve() gives up on. The search tries both colors of one
+    //cell at a time, depth first, and lets the rules propagate every choice.
+    //Choices that failed are kept as nogoods across restarts. Returns
+    //SOLUTION_FOUND with the board filled in, CONTRADICTION_FOUND if no
+    //solution exists, or CANNOT_PROCEED once the deadline passes; in that
+    //case the cells the search proved are still marked.
+    SitRep search(steady_clock_tp deadline, bool verbose = true);
+
+    struct SolutionCount {
+        //Solutions found, at most the limit.
+        int solutions = 0;
+        //Whether the whole tree was searched, so that solutions is exact.
+        bool exhausted = false;
+        //The first two solutions found, as board() shows them.
+        std::vector<std::string> witnesses;
+    };
+
+    //Counts the solutions up to `limit` by searching every branch, the
+    //subtrees split over the threads set_threads() allows. First the guesses
+    //that fail are ruled out, as solve() would, so that a puzzle with one
+    //solution costs about one solve. The board is left as it is. The search
+    //stops at the limit or the deadline.
+    SolutionCount count_solutions(int limit = 2,
+                                  steady_clock_tp deadline = steady_clock_tp::max());
+
+    //The number of threads analyze_hypotheticals() may use, the caller included.
+    void set_threads(unsigned threads) noexcept;
+
+    //How analyze_hypotheticals() probes its guesses. The local rules are
+    //analyze_complete_islands(), analyze_single_liberty(),
+    //analyze_dual_liberties() and the part of analyze_potential_pools() that
+    //only looks at 2x2 windows; the others flood fill. FULL, the default,
+    //probes every guess with all rules. LOCAL_FIRST probes every guess with
+    //the local rules first and only escalates to all rules when none of them
+    //settles anything. ADAPTIVE does the same but backs off from the local
+    //pass for a while each time it comes up empty.
+    enum struct Probing {
+        FULL,
+        LOCAL_FIRST,
+        ADAPTIVE,
+    };
+    void set_probing(Probing probing) noexcept;
+
     int knownElements() const;
+
+    //The cells row by row: '#' black, '.' white or numbered, '?' unknown.
+    std::string board() const;
+
+    //The parts of solve() that are counted and can be timed. Counts are
+    //inclusive: confined() also counts towards the phases that call it, and the
+    //guesses probed by analyze_hypotheticals() add to every phase they run.
+    enum Phase : unsigned char {
+        PHASE_COMPLETE_ISLANDS,
+        PHASE_SINGLE_LIBERTY,
+        PHASE_DUAL_LIBERTIES,
+        PHASE_UNREACHABLE_CELLS,
+        PHASE_POTENTIAL_POOLS,
+        PHASE_CONTRADICTIONS,
+        PHASE_CONFINEMENT,
+        PHASE_HYPOTHETICALS,
+        PHASE_CONFINED,
+        PHASE_COMPUTE_REACH,
+        PHASE_COUNT,
+    };
+
+    //decided counts the cells the phase marked.
+    struct PhaseStats {
+        long long calls = 0;
+        long long decided = 0;
+        std::chrono::nanoseconds time{0};
+    };
+
+    //What the Grid has done since it was built or reset_stats() was called.
+    //Counting costs an increment here and there; a build that defines
+    //NB_NO_STATS leaves it out altogether. Times are only taken while
+    //set_timing(true) is in effect, as reading the clock is not free.
+    struct Stats {
+        std::array<PhaseStats, PHASE_COUNT> phases{};
+
+        //confined() found a valid footprint, or had to search.
+        long long footprint_hits = 0;
+        long long footprint_misses = 0;
+
+        //compute_reach() found the field current, or had to rebuild it.
+        long long reach_hits = 0;
+        long long reach_misses = 0;
+
+        //Grid copies made by analyze_hypotheticals() and guesses probed on them.
+        long long copies = 0;
+        long long guesses = 0;
+
+        //Guesses analyze_hypotheticals() skipped because nothing they touched
+        //had changed since they last settled nothing, and guesses it probed.
+        long long probe_hits = 0;
+        long long probe_misses = 0;
+
+        //Guesses probed with the local rules only, analyze_hypotheticals()
+        //calls those settled, and calls that had to escalate to all rules.
+        long long local_guesses = 0;
+        long long local_wins = 0;
+        long long escalations = 0;
+
+        //Nodes search() propagated, choices that failed, and restarts.
+        long long search_nodes = 0;
+        long long search_conflicts = 0;
+        long long search_restarts = 0;
+
+        Stats& operator+=(Stats const& other) noexcept;
+        void write_json(std::ostream& os) const;
+    };
+
+#ifdef NB_NO_STATS
+    static constexpr bool collect_stats = false;
+#else
+    static constexpr bool collect_stats = true;
+#endif
+
+    //The member function the phase stands for, such as "analyze_confinement".
+    static std::string_view phase_name(Phase phase) noexcept;
+
+    //Timing is off by default.
+    void set_timing(bool on) noexcept;
+    Stats const& stats() const noexcept;
+    void reset_stats() noexcept;
+
+    //The steps solve(true) took, as HTML with a board per step. The trace is
+    //on from the start; set_trace(false) drops it and stops recording it, for
+    //runs that only want the result.
     void write(std::ostream& os, steady_clock_tp start, steady_clock_tp finish) const;
+    //The same trace as JSON: the board at the start, then per step only the
+    //cells it decided.
+    void write_trace_json(std::ostream& os) const;
+    void set_trace(bool on);
 
 private:
     enum struct State : int {
+        BORDER = -4,
         UNKNOWN = -3,
         WHITE = -2,
         BLACK = -1,
     };
 #pragma region
+    //A Region is a cheap handle to the root of one set of the disjoint-set
+    //forest in m_parent. The per-root data (size, kind and liberties) lives in
+    //the Grid, so handles are freely copied and compare equal by root.
+    //It behaves like a pointer: a default constructed Region is null.
     class Region {
     public:
-        Region(State const state, set_pair_t const& unknowns, int const x, int const y);
-        constexpr bool is_white() const noexcept { return m_state == State::WHITE; }
-        constexpr bool is_black() const noexcept { return m_state == State::BLACK; }
-        constexpr bool is_numbered() const noexcept { return static_cast<int>(m_state) > 0; }
+        class iterator {
+        public:
+            iterator(Grid const* grid, int start, int curr) noexcept;
+            std::pair<int, int> operator*() const noexcept;
+            iterator& operator++() noexcept;
+            bool operator!=(iterator const& other) const noexcept { return m_curr != other.m_curr; }
+
+        private:
+            Grid const* m_grid;
+            int m_start;
+            int m_curr;
+        };
+
+        constexpr Region() noexcept = default;
+        constexpr Region(Grid const& grid, int const root) noexcept : m_grid{&grid}, m_root{root} {}
+
+        constexpr explicit operator bool() const noexcept { return m_root >= 0; }
+        constexpr Region const* operator->() const noexcept { return this; }
+        constexpr Region const& operator*() const noexcept { return *this; }
+        constexpr bool operator==(Region const& other) const noexcept { return m_root == other.m_root; }
+        constexpr bool operator!=(Region const& other) const noexcept { return m_root != other.m_root; }
+
+        constexpr int root() const noexcept { return m_root; }
+        bool is_white() const noexcept { return kind() == State::WHITE; }
+        bool is_black() const noexcept { return kind() == State::BLACK; }
+        bool is_numbered() const noexcept { return static_cast<int>(kind()) > 0; }
         int its_number() const noexcept;
-        set_pair_t::const_iterator begin() const;
-        set_pair_t::const_iterator end() const;
+        iterator begin() const noexcept;
+        iterator end() const noexcept;
         int size() const noexcept;
         bool contains(int const x, int const y) const noexcept;
 
-        template <typename It>
-        inline void insert(It first, It last);
-
-        set_pair_t::const_iterator unk_begin() const;
-        set_pair_t::const_iterator unk_end() const;
-
-        template <typename It>
-        inline void unk_insert(It first, It last);
-
+        //The unknown cells next to the region, by cell index.
+        CellSet::const_iterator unk_begin() const;
+        CellSet::const_iterator unk_end() const;
         int unk_size() const noexcept;
-        void unk_erase(int const x, int const y) noexcept;
 
     private:
-        State m_state;
-
-        //Tracks the regions.
-        set_pair_t m_coords;
+        State kind() const noexcept;
 
-        //Track what unknowns cells surround the region.
-        set_pair_t m_unknowns;
+        Grid const* m_grid = nullptr;
+        int m_root = -1;
     };
 #pragma endregion
 
-    using cache_map_t = std::map<std::shared_ptr<Region>, set_pair_t>;
+    //The rules that re-examine only what changed since they last ran, see touch().
+    enum Rule : unsigned char {
+        RULE_COMPLETE_ISLANDS,
+        RULE_SINGLE_LIBERTY,
+        RULE_DUAL_LIBERTIES,
+        RULE_COUNT,
+    };
+
+    //One undoable write to the board, see checkpoint(). i is a cell index
+    //(for ROOTS and UNKNOWNS a position in the list) and value the overwritten value.
+    //The LIB_ changes record a cell index i moved in or out of m_liberties[value],
+    //the QUEUE_ changes a cell index i put in or taken out of m_dirty[value].
+    struct Change {
+        enum Kind : unsigned char {
+            STATE,
+            KIND,
+            PARENT,
+            NEXT,
+            SIZE,
+            ROOT_POS,
+            ROOTS,
+            ROOTS_PUSH,
+            ROOTS_POP,
+            UNKNOWNS,
+            UNKNOWN_POS,
+            UNKNOWNS_POP,
+            QUEUE_PUSH,
+            QUEUE_TAKE,
+            LIB_INSERT,
+            LIB_ERASE,
+            LIB_SWAP,
+            FOOTPRINT,
+            FOOTPRINT_DROP,
+            WATCH,
+            SITREP,
+        };
+        Kind kind;
+        int i;
+        int value;
+    };
+
+    //What a plain confined() search from a region found: whether the region is
+    //confined and which unknown cells it consumed on the way.
+    struct Footprint {
+        unsigned long generation = 0;
+        bool valid = false;
+        bool confined = false;
+        CellSet consumed;
+    };
+
+    //A guess that settled nothing. The footprint holds the cells either color
+    //decided and their unknown neighbors, all of them unknown at the time.
+    struct Probe {
+        std::vector<int> footprint;
+    };
 
     int m_width;
     int m_height;
 
+    //Row pitch of the padded board: one sentinel column on each side.
+    int m_stride;
+
     std::mutex mt;
 
+    unsigned m_threads;
+
     //The total black cells in the solution.
     int m_total_black;
 
-    //m_cells[x][y].first is the state of the cell.
-    //m_cells[x][y].second is the region of the cell.
-    std::vector<std::vector<std::pair<State, std::shared_ptr<Region>>>> m_cells;
+    //The board is stored flat with a one cell wide State::BORDER frame, so
+    //neighbor and 2x2 scans never need bounds checks. See index().
+    //m_states[i] is the state of the cell.
+    std::vector<State> m_states;
+
+    //Disjoint-set forest of the regions over the same cell indices, with path
+    //compression in find() and union by size in fuse_regions().
+    //m_parent[i] is -1 when the cell belongs to no region.
+    mutable std::vector<int> m_parent;
+
+    //Threads the cells of each set into a circular list so a region can be walked.
+    std::vector<int> m_next;
+
+    //Per-root data, only meaningful where m_parent[i] == i.
+    //m_liberties tracks what unknown cells surround the region.
+    std::vector<int> m_size;
+    std::vector<State> m_kind;
+    std::vector<CellSet> m_liberties;
 
     //Initially is KEEP_GOING.
     SitRep m_sitRep;
 
-    std::set<std::shared_ptr<Region>> m_regions;
-
-    //This stores the output to be generated and converts into HTML.
-    std::vector<std::tuple<std::string_view, std::vector<std::vector<State>>,
-        set_pair_t, steady_clock_tp, int, set_pair_t>> m_output;
+    //The roots of all live regions. m_root_pos[root] is the root's position in m_roots.
+    std::vector<int> m_roots;
+    std::vector<int> m_root_pos;
+
+    //The cells still unknown, so rules can skip the decided part of the board.
+    //m_unknown_pos[i] is the cell's position in m_unknowns, or -1.
+    std::vector<int> m_unknowns;
+    std::vector<int> m_unknown_pos;
+
+    //Propagation queues. m_dirty[rule] holds the cells whose region changed
+    //since the rule last ran, and bit `rule` of m_queued[i] is set while cell
+    //i is waiting in that queue.
+    std::array<std::vector<int>, RULE_COUNT> m_dirty;
+    std::vector<unsigned char> m_queued;
+
+    //m_states again as one bitboard per state, for the 2x2 pool kernels.
+    //Numbered cells count as white. Kept in step by set_bits().
+    Bitboard m_black;
+    Bitboard m_white;
+    Bitboard m_unknown;
+
+    //Reachability field filled by compute_reach(). m_reach[i] is the most cells
+    //any numbered island could still add after growing to cell i, or -1 when no
+    //island can reach it. m_reach_from[i] is the cell the label came from and
+    //m_reach_owner[i] the island's root. m_reach_epoch is the m_epoch the field
+    //was computed at, m_epoch being bumped by every mark() and rollback().
+    //The m_blocked_ pair is scratch for reachable_without().
+    std::vector<int> m_reach;
+    std::vector<int> m_reach_from;
+    std::vector<int> m_reach_owner;
+    std::vector<int> m_blocked_reach;
+    std::vector<int> m_blocked_from;
+    std::vector<std::vector<int>> m_reach_buckets;
+    unsigned long m_reach_epoch;
+    unsigned long m_epoch;
+
+    //Confinement cache, kept across solve() calls. m_footprints[root] is only
+    //trusted while valid; it is dropped when a cell the search looked at is
+    //marked or when the root takes part in a fusion. m_watchers[i] lists the
+    //(root, generation) pairs of the searches that looked at cell i. Footprints
+    //replaced while a checkpoint is open wait in m_footprint_saved for rollback().
+    std::vector<Footprint> m_footprints;
+    std::vector<Footprint> m_footprint_saved;
+    std::vector<std::vector<std::pair<int, unsigned long>>> m_watchers;
+    unsigned long m_footprint_generation;
+
+    //The guesses of analyze_hypotheticals() that settled nothing, by guessed
+    //cell. A probe is skipped while every cell of its footprint is unknown.
+    std::vector<Probe> m_probes;
+
+    //See set_probing(). Under ADAPTIVE the local pass is skipped for the next
+    //m_local_skip calls; every pass that comes up empty doubles the wait.
+    Probing m_probing;
+    int m_local_skip;
+    int m_local_backoff;
+
+    //See stats() and set_timing().
+    bool m_timing;
+    Stats m_stats;
+
+    //See write(). Every state written outside a checkpoint goes to the trace.
+    Trace m_trace;
 
-    static std::regex const rx;
     std::mt19937 m_eng;
+
+    //While a checkpoint is open every change is logged here, so that
+    //rollback() can undo a hypothesis in time proportional to its changes.
+    std::vector<Change> m_trail;
+    int m_checkpoints;
+
+    //The temporaries of one solve() step: the cells each rule marks, the cells
+    //it forbids, the regions it takes from the queues. Every step starts by
+    //releasing what the last one took, which costs nothing, so after the
+    //first steps a Grid, and each copy a thread probes on, stays off the
+    //global allocator. The arena only reaches for the heap past its buffer.
+    static constexpr std::size_t arena_size = 64 * 1024;
+    std::vector<std::byte> m_arena_buffer;
+    std::pmr::monotonic_buffer_resource m_arena;
     //std::string m_string;
 
 
     Grid(Grid const& other);
 
+    enum struct Format {
+        PLAIN,
+        COMPACT,
+    };
+    Grid(std::pair<int, int> size, std::string_view s, Format format);
+    [[nodiscard]] static std::pair<int, int> compact_size(std::string_view compact);
+
+    [[nodiscard]] std::size_t checkpoint();
+    void rollback(std::size_t checkpoint);
+    void write(Change::Kind kind, int i, int value);
+    void record(Change::Kind kind, int i, int value);
+    void undo(Change const& change);
+    void set_bits(int i, State state);
+
+    class PhaseTimer;
+
     [[nodiscard]] bool analyze_complete_islands(bool  verbose);
     [[nodiscard]] bool analyze_single_liberty(bool verbose);
     [[nodiscard]] bool analyze_dual_liberties(bool verbose);
     [[nodiscard]] bool analyze_unreachable_cells(bool verbose);
-    [[nodiscard]] bool analyze_potential_pools(bool verbose);
-    [[nodiscard]] bool analyze_confinement(bool verbose, cache_map_t& cache);
-    [[nodiscard]] bool analyze_hypotheticals(bool verbose);
+    //Local, it leaves out the threats that need reachable_without().
+    [[nodiscard]] bool analyze_potential_pools(bool verbose, bool local = false);
+    [[nodiscard]] bool analyze_confinement(bool verbose);
+    //With refute_only, a guess never wins by reaching a solution, only by a
+    //color that fails or by cells both colors agree on, so what it marks
+    //holds in every solution. No guess starts after the deadline.
+    [[nodiscard]] bool analyze_hypotheticals(bool verbose, bool refute_only = false,
+                                             steady_clock_tp deadline = steady_clock_tp::max());
+    //solve() without guessing and with the local rules only.
+    SitRep solve_local();
+    [[nodiscard]] bool all_unknown(std::vector<int> const& cells) const noexcept;
 
     std::vector<std::pair<int, int>> guessing_order();
     [[nodiscard]] bool valid(int x, int y);
 
+    [[nodiscard]] constexpr int index(int x, int y) const noexcept { return (x + 1) + (y + 1) * m_stride; }
+    [[nodiscard]] std::pair<int, int> coords(int i) const noexcept;
+
     State& cell(int x, int y);
     [[nodiscard]] State const& cell(int x, int y) const;
 
-    std::shared_ptr<Region>& region(int x, int y);
-    [[nodiscard]] std::shared_ptr<Region> const& region(int x, int y) const;
+    //Path compression is skipped while a checkpoint is open, as the
+    //rewired parents could not be undone by rollback().
+    [[nodiscard]] int find(int i) const noexcept;
+    [[nodiscard]] Region region(int x, int y) const;
 
-    void print(std::string_view s, set_pair_t const& updated = {},
-               int failed_guesses = 0, set_pair_t const& failed_coords = {});
+    void print(std::string_view s, int failed_guesses = 0, CellSet const& failed_cells = {});
 
-    [[nodiscard]] bool process(bool verbose, set_pair_t const& mark_as_black,
-                               set_pair_t const& mark_as_white, std::string_view s, int const failed_guesses = 0,
-                               set_pair_t const& failed_coords = {});
+    [[nodiscard]] bool process(bool verbose, CellSet const& mark_as_black,
+                               CellSet const& mark_as_white, std::string_view s, int const failed_guesses = 0,
+                               CellSet const& failed_cells = {});
 
     template <typename F>
     void for_valid_neighbors(int x, int y, F f) const;
 
-    void insert_valid_neighbors(set_pair_t& s, int x, int y) const;
-    void insert_valid_unknown_neighbors(set_pair_t& s, int x, int y) const;
+    void insert_valid_neighbors(CellSet& s, int x, int y) const;
+    void insert_valid_unknown_neighbors(CellSet& s, int x, int y) const;
+
+    void enqueue(Rule rule, int i);
+    void touch(int i);
+    //The regions queued for the rule, in the arena.
+    [[nodiscard]] std::pmr::vector<int> take_dirty(Rule rule);
 
     void add_region(int x, int y);
     void mark(State const state, int x, int y);
-    void fuse_regions(std::shared_ptr<Region> r1, std::shared_ptr<Region> r2);
+    void fuse_regions(Region r1, Region r2);
 
     [[nodiscard]] bool impossibly_big_white_region(int n) const;
-    [[nodiscard]] bool unreachable(int x_root, int y_root, set_pair_t discovered = {});
-    [[nodiscard]] bool confined(std::shared_ptr<Region> const& r, cache_map_t& cache, set_pair_t const& verboten = {});
-
-    bool detect_contradictions(bool verbose, cache_map_t& cache);
+    void compute_reach();
+    void compute_reach(int blocked, std::vector<int>& reach, std::vector<int>& from);
+    [[nodiscard]] bool reachable_without(int i, int blocked);
+    [[nodiscard]] bool confined(Region const r, CellSet const& verboten = {});
+    [[nodiscard]] bool search_confined(Region const r, CellSet const& verboten, bool remember);
+    //Stride 0 reads m_stride.
+    template <int Stride>
+    [[nodiscard]] bool search_confined(Region const r, CellSet const& verboten, bool remember);
+    void drop_footprint(int root);
+
+    bool detect_contradictions(bool verbose);
+
+    //See search().
+    struct Search;
+    [[nodiscard]] SitRep propagate(Search& s);
+    [[nodiscard]] SitRep branch(Search& s);
+    [[nodiscard]] std::pair<int, State> pick_branch();
+
+    //See count_solutions().
+    struct Counter;
+    void count_below(Search& s, Counter& c);
 
 };
 
@@ -151,26 +506,19 @@ private:
 std::string format_time(Grid::steady_clock_tp const start, Grid::steady_clock_tp const finish);
 
 //member function templates.
-template <typename It>
-inline void Grid::Region::insert(It first, It last) {
-    m_coords.insert(first, last);
-}
-template <typename It>
-inline void Grid::Region::unk_insert(It first, It last) {
-    m_unknowns.insert(first, last);
-}
 template <typename  F>
 void Grid::for_valid_neighbors(int x, int y, F f) const { 
-    if (x > 0) {
+    int const i = index(x, y);
+    if (m_states[i - 1] != State::BORDER) {
         f(x - 1, y);
     }
-    if (x + 1 < m_width) {
+    if (m_states[i + 1] != State::BORDER) {
         f(x + 1, y);
     }
-    if (y > 0) {
+    if (m_states[i - m_stride] != State::BORDER) {
         f(x, y - 1);
     }
-    if (y + 1 < m_height) {
+    if (m_states[i + m_stride] != State::BORDER) {
         f(x, y + 1);
     }
 }
@@ -1,18 +1,158 @@
 #include "Log.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <iostream>
 
-Logger::Logger() {
-    std::lock_guard lock{m_mutex};
-    m_outfile.open("Log.txt");
+namespace {
+    std::string_view level_name(Logger::Level const level) {
+        switch(level) {
+            case Logger::Level::DEBUG:   return "[DEBUG] ";
+            case Logger::Level::INFO:    return "[INFO] ";
+            case Logger::Level::WARNING: return "[WARNING] ";
+            default:                     return "[ERROR] ";
+        }
+    }
+
+    //How long the drainer sleeps when nobody wakes it.
+    constexpr std::chrono::milliseconds drain_period{50};
+}
+
+Logger::Logger()
+    : m_level{Level::INFO}
+    , m_echo{true}
+    , m_rings_mutex{}
+    , m_rings{}
+    , m_drain_mutex{}
+    , m_outfile{"Log.txt"}
+    , m_batch{}
+    , m_wake_mutex{}
+    , m_wake{}
+    , m_stop{false} {
+    m_drainer = std::thread([this] {
+        std::unique_lock lock{m_wake_mutex};
+        while(!m_stop) {
+            m_wake.wait_for(lock, drain_period);
+            lock.unlock();
+            drain();
+            lock.lock();
+        }
+    });
+}
+
+void Logger::set_level(Level const level) noexcept {
+    m_level.store(level, std::memory_order_relaxed);
 }
 
-void Logger::msg(std::string_view message) {
-    std::lock_guard lock{m_mutex};
-    m_outfile << message << std::endl;
-    std::cout << "LOG: " << message << std::endl;
+bool Logger::enabled(Level const level) const noexcept {
+    return level >= compiled_level && level >= m_level.load(std::memory_order_relaxed);
+}
+
+void Logger::echo(bool const on) {
+    m_echo.store(on, std::memory_order_relaxed);
+}
+
+void Logger::flush() {
+    drain();
+}
+
+//A thread takes a ring on its first message and gives it back when it ends,
+//so a pool of threads keeps reusing the same few rings. A ring given back may
+//still hold messages; they are drained like any other.
+Logger::Ring& Logger::ring() {
+    struct Owner {
+        Ring* ring = nullptr;
+        ~Owner() {
+            if(ring) {
+                ring->owned.store(false, std::memory_order_release);
+            }
+        }
+    };
+    thread_local Owner owner;
+
+    if(!owner.ring) {
+        std::lock_guard lock{m_rings_mutex};
+        for(auto const& r : m_rings) {
+            bool expected = false;
+            if(r->owned.compare_exchange_strong(expected, true, std::memory_order_acq_rel)) {
+                owner.ring = r.get();
+                break;
+            }
+        }
+        if(!owner.ring) {
+            m_rings.push_back(std::make_unique<Ring>());
+            owner.ring = m_rings.back().get();
+            owner.ring->owned.store(true, std::memory_order_relaxed);
+        }
+    }
+    return *owner.ring;
+}
+
+void Logger::push(Level const level, std::string_view const message) {
+    Ring& r = ring();
+    std::size_t const head = r.head.load(std::memory_order_relaxed);
+
+    //A full ring is drained by its producer rather than waiting for the drainer.
+    if(head - r.tail.load(std::memory_order_acquire) == Ring::capacity) {
+        drain();
+    }
+
+    Ring::Record& record = r.records[head % Ring::capacity];
+    auto const size = std::min(message.size(), record.text.size());
+    record.level = level;
+    record.size = static_cast<unsigned char>(size);
+    std::memcpy(record.text.data(), message.data(), size);
+    r.head.store(head + 1, std::memory_order_release);
+
+    if(head + 1 - r.tail.load(std::memory_order_relaxed) == Ring::capacity / 2) {
+        m_wake.notify_one();
+    }
+}
+
+void Logger::drain() {
+    std::lock_guard lock{m_drain_mutex};
+    m_batch.clear();
+    {
+        std::lock_guard rings_lock{m_rings_mutex};
+        for(auto const& r : m_rings) {
+            std::size_t const head = r->head.load(std::memory_order_acquire);
+            std::size_t tail = r->tail.load(std::memory_order_relaxed);
+            for(; tail != head; tail++) {
+                Ring::Record const& record = r->records[tail % Ring::capacity];
+                m_batch += level_name(record.level);
+                m_batch.append(record.text.data(), record.size);
+                m_batch += '\n';
+            }
+            r->tail.store(tail, std::memory_order_release);
+        }
+    }
+    if(m_batch.empty()) {
+        return;
+    }
+
+    m_outfile << m_batch;
+    m_outfile.flush();
+    if(m_echo.load(std::memory_order_relaxed)) {
+        std::string echoed;
+        for(std::size_t begin = 0; begin < m_batch.size();) {
+            auto const end = m_batch.find('\n', begin) + 1;
+            echoed += "LOG: ";
+            echoed.append(m_batch, begin, end - begin);
+            begin = end;
+        }
+        std::cout << echoed << std::flush;
+    }
 }
 
 Logger::~Logger() {
+    {
+        std::lock_guard lock{m_wake_mutex};
+        m_stop = true;
+    }
+    m_wake.notify_one();
+    m_drainer.join();
+    drain();
     m_outfile.close();
 }
-Logger Logger::lg;
\ No newline at end of file
+Logger Logger::lg;
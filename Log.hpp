@@ -1,21 +1,127 @@
-#include <thread>
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <fstream>
+#include <memory>
 #include <mutex>
+#include <string>
 #include <string_view>
-#include <fstream>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+//Levels below NB_LOG_LEVEL are compiled out: 0 keeps everything, 4 drops
+//every message.
+#ifndef NB_LOG_LEVEL
+#define NB_LOG_LEVEL 0
+#endif
 
+//Writes to Log.txt, and to std::cout unless echo is off. Callers only format
+//their message and append it to a ring buffer of their own thread; a
+//background thread drains the rings and does the I/O in batches. A message
+//below the compiled or the runtime level costs one comparison, and its
+//arguments are never formatted.
 class Logger {
     Logger();
 public:
+    enum struct Level : unsigned char {
+        DEBUG,
+        INFO,
+        WARNING,
+        ERROR,
+    };
+
+    static constexpr Level compiled_level = static_cast<Level>(NB_LOG_LEVEL);
+
     Logger(Logger const& other) = delete;
     Logger& operator=(Logger const& other) = delete;
     Logger(Logger&& other) = delete;
     Logger& operator=(Logger&& other) = delete;
     ~Logger();
 
-    void msg(std::string_view message);
+    //Appends its arguments, strings or numbers, to one message.
+    template <Level level, typename... Args>
+    void log(Args const&... args);
+
+    template <typename... Args> void debug(Args const&... args) { log<Level::DEBUG>(args...); }
+    template <typename... Args> void info(Args const&... args) { log<Level::INFO>(args...); }
+    template <typename... Args> void warning(Args const&... args) { log<Level::WARNING>(args...); }
+    template <typename... Args> void error(Args const&... args) { log<Level::ERROR>(args...); }
+
+    //Messages below `level` are dropped at run time, INFO by default.
+    void set_level(Level level) noexcept;
+    [[nodiscard]] bool enabled(Level level) const noexcept;
+
+    //Whether messages are also copied to std::cout, which they are by default.
+    void echo(bool on);
+
+    //Returns once every message logged before the call has been written.
+    void flush();
+
     static Logger lg;
 
 private:
-    std::mutex m_mutex;
+    //A single producer, single consumer queue of fixed size messages. Longer
+    //messages are cut.
+    struct Ring {
+        struct Record {
+            Level level;
+            unsigned char size;
+            std::array<char, 254> text;
+        };
+        static constexpr std::size_t capacity = 256;
+
+        std::array<Record, capacity> records;
+        alignas(64) std::atomic<std::size_t> head{0};
+        alignas(64) std::atomic<std::size_t> tail{0};
+        std::atomic<bool> owned{false};
+    };
+
+    template <typename T>
+    static void append(std::string& s, T const& value);
+
+    void push(Level level, std::string_view message);
+    Ring& ring();
+    void drain();
+
+    std::atomic<Level> m_level;
+    std::atomic<bool> m_echo;
+
+    std::mutex m_rings_mutex;
+    std::vector<std::unique_ptr<Ring>> m_rings;
+
+    //Taken by whoever drains, so each ring has one consumer at a time.
+    std::mutex m_drain_mutex;
     std::ofstream m_outfile;
+    std::string m_batch;
+
+    std::mutex m_wake_mutex;
+    std::condition_variable m_wake;
+    bool m_stop;
+    std::thread m_drainer;
 };
+
+template <typename T>
+void Logger::append(std::string& s, T const& value) {
+    if constexpr(std::is_arithmetic_v<T>) {
+        s += std::to_string(value);
+    } else {
+        s += std::string_view(value);
+    }
+}
+
+template <Logger::Level level, typename... Args>
+void Logger::log(Args const&... args) {
+    if constexpr(level >= compiled_level) {
+        if(!enabled(level)) {
+            return;
+        }
+        thread_local std::string message;
+        message.clear();
+        (append(message, args), ...);
+        push(level, message);
+    }
+}
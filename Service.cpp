@@ -0,0 +1,284 @@
+#include "Service.hpp"
+#include "Batch.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <istream>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#if !defined(_WIN32)
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    //Writes are not worth a SIGPIPE when a client hangs up early.
+#if defined(MSG_NOSIGNAL)
+    constexpr int send_flags = MSG_NOSIGNAL;
+#else
+    constexpr int send_flags = 0;
+#endif
+}
+
+#if !defined(_WIN32)
+struct SolverService::Connection {
+    explicit Connection(int const fd) noexcept : fd{fd} {}
+    Connection(Connection const& other) = delete;
+    Connection& operator=(Connection const& other) = delete;
+    ~Connection() { ::close(fd); }
+
+    //Answers may come from several workers at once; each goes out whole. A
+    //client that went away just loses its answers.
+    void send(std::string const& answer) {
+        std::lock_guard lock{mutex};
+        for(std::size_t sent = 0; sent < answer.size();) {
+            auto const n = ::send(fd, answer.data() + sent, answer.size() - sent, send_flags);
+            if(n < 0 && errno == EINTR) {
+                continue;
+            }
+            if(n <= 0) {
+                return;
+            }
+            sent += static_cast<std::size_t>(n);
+        }
+    }
+
+    int const fd;
+    std::mutex mutex;
+};
+#else
+struct SolverService::Connection {};
+#endif
+
+SolverService::SolverService(unsigned const threads, std::chrono::milliseconds const budget)
+    : m_budget{budget}
+    , m_mutex{}
+    , m_work{}
+    , m_idle{}
+    , m_jobs{}
+    , m_busy{0}
+    , m_requests{0}
+    , m_stop{false}
+    , m_workers{}
+    , m_socket_mutex{}
+    , m_read{}
+    , m_listener{-1}
+    , m_stopping{false}
+    , m_connections{} {
+
+    unsigned const n = std::max(1u, threads);
+    m_workers.reserve(n);
+    for(unsigned i = 0; i < n; i++) {
+        m_workers.emplace_back([this] { work(); });
+    }
+}
+
+SolverService::~SolverService() {
+    {
+        std::lock_guard lock{m_mutex};
+        m_stop = true;
+    }
+    m_work.notify_all();
+    for(auto& t : m_workers) {
+        t.join();
+    }
+}
+
+std::pair<std::string, std::chrono::milliseconds> SolverService::parse(std::string_view const request) const {
+    auto const [ head, puzzle ] = BatchSolver::split(request);
+    auto const space = head.rfind(' ');
+    if(space == std::string_view::npos) {
+        return { std::string(request), m_budget };
+    }
+    auto const ms = head.substr(space + 1);
+    if(ms.empty() || !std::all_of(ms.begin(), ms.end(), [](unsigned char c) { return std::isdigit(c); })) {
+        return { std::string(request), m_budget };
+    }
+    std::string line(head.substr(0, space));
+    line += ' ';
+    line += puzzle;
+    return { line, std::chrono::milliseconds(std::stoll(std::string(ms))) };
+}
+
+void SolverService::submit(std::string_view line, std::function<void(std::string const&)> answer) {
+    if(!line.empty() && line.back() == '\r') {
+        line.remove_suffix(1);
+    }
+    if(!BatchSolver::is_puzzle(line)) {
+        return;
+    }
+    {
+        std::lock_guard lock{m_mutex};
+        m_jobs.push_back(Job{std::string(line), ++m_requests, std::chrono::steady_clock::now(), std::move(answer)});
+    }
+    m_work.notify_one();
+}
+
+//Jobs are taken first come, first served: under load a request waits for
+//the ones before it rather than for whichever puzzle is hardest.
+void SolverService::work() {
+    for(;;) {
+        Job job;
+        {
+            std::unique_lock lock{m_mutex};
+            m_work.wait(lock, [this] { return m_stop || !m_jobs.empty(); });
+            if(m_jobs.empty()) {
+                return;
+            }
+            job = std::move(m_jobs.front());
+            m_jobs.pop_front();
+            m_busy++;
+        }
+
+        auto const [ line, budget ] = parse(job.request);
+        auto const waited = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - job.arrival);
+        auto const left = budget.count() > 0
+            ? std::max(budget - waited, std::chrono::milliseconds{1}) : budget;
+
+        std::ostringstream os;
+        os << BatchSolver::solve(line, job.number, left) << '\n';
+        job.answer(os.str());
+
+        std::lock_guard lock{m_mutex};
+        if(--m_busy == 0 && m_jobs.empty()) {
+            m_idle.notify_all();
+        }
+    }
+}
+
+void SolverService::drain() {
+    std::unique_lock lock{m_mutex};
+    m_idle.wait(lock, [this] { return m_busy == 0 && m_jobs.empty(); });
+}
+
+std::size_t SolverService::serve(std::istream& in, std::ostream& out) {
+    std::mutex out_mutex;
+    std::size_t requests = 0;
+    std::string line;
+    while(std::getline(in, line)) {
+        requests += BatchSolver::is_puzzle(line) ? 1 : 0;
+        submit(line, [&](std::string const& answer) {
+            std::lock_guard lock{out_mutex};
+            out << answer << std::flush;
+        });
+    }
+    drain();
+    return requests;
+}
+
+#if !defined(_WIN32)
+void SolverService::read(std::shared_ptr<Connection> const connection) {
+    std::string pending;
+    char buffer[4096];
+    auto const answer = [connection](std::string const& s) { connection->send(s); };
+
+    for(;;) {
+        auto const n = ::recv(connection->fd, buffer, sizeof buffer, 0);
+        if(n < 0 && errno == EINTR) {
+            continue;
+        }
+        if(n <= 0) {
+            break;
+        }
+        pending.append(buffer, static_cast<std::size_t>(n));
+
+        std::size_t begin = 0;
+        for(auto newline = pending.find('\n'); newline != std::string::npos; newline = pending.find('\n', begin)) {
+            submit(std::string_view(pending).substr(begin, newline - begin), answer);
+            begin = newline + 1;
+        }
+        pending.erase(0, begin);
+    }
+    //A last request may lack its line break.
+    submit(pending, answer);
+
+    //The reader is detached: it holds the lock until it is gone for good, so
+    //serve_socket() cannot return under it.
+    std::unique_lock lock{m_socket_mutex};
+    m_connections.erase(std::find(m_connections.begin(), m_connections.end(), connection));
+    std::notify_all_at_thread_exit(m_read, std::move(lock));
+}
+
+void SolverService::serve_socket(std::string const& path) {
+    sockaddr_un address{};
+    if(path.empty() || path.size() >= sizeof address.sun_path) {
+        throw std::runtime_error("Bad socket path: " + path);
+    }
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+    int const listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if(listener < 0) {
+        throw std::runtime_error(std::string("socket() failed: ") + std::strerror(errno));
+    }
+    ::unlink(path.c_str());
+    if(::bind(listener, reinterpret_cast<sockaddr const*>(&address), sizeof address) < 0
+        || ::listen(listener, SOMAXCONN) < 0) {
+
+        int const error = errno;
+        ::close(listener);
+        throw std::runtime_error("Cannot listen on " + path + ": " + std::strerror(error));
+    }
+    {
+        std::lock_guard lock{m_socket_mutex};
+        m_listener = listener;
+        if(m_stopping) {
+            ::shutdown(listener, SHUT_RDWR);
+        }
+    }
+
+    //stop() shuts the listener down, which fails the accept().
+    for(;;) {
+        int const fd = ::accept(listener, nullptr, nullptr);
+        if(fd < 0 && errno == EINTR) {
+            continue;
+        }
+        if(fd < 0) {
+            break;
+        }
+        auto connection = std::make_shared<Connection>(fd);
+        std::lock_guard lock{m_socket_mutex};
+        m_connections.push_back(connection);
+        std::thread([this, connection] { read(connection); }).detach();
+    }
+
+    //Ends the reads still going and waits for the readers to let go.
+    {
+        std::unique_lock lock{m_socket_mutex};
+        for(auto const& c : m_connections) {
+            ::shutdown(c->fd, SHUT_RD);
+        }
+        m_read.wait(lock, [this] { return m_connections.empty(); });
+        m_listener = -1;
+        m_stopping = false;
+    }
+    drain();
+    ::close(listener);
+    ::unlink(path.c_str());
+}
+
+void SolverService::stop() {
+    std::lock_guard lock{m_socket_mutex};
+    m_stopping = true;
+    if(m_listener >= 0) {
+        ::shutdown(m_listener, SHUT_RDWR);
+    }
+}
+#else
+void SolverService::read(std::shared_ptr<Connection> const) {
+}
+
+void SolverService::serve_socket(std::string const&) {
+    throw std::runtime_error("Unix domain sockets are not supported on this platform");
+}
+
+void SolverService::stop() {
+}
+#endif
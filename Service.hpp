@@ -0,0 +1,99 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+//Solves puzzles as they arrive, for callers that would otherwise start
+//nb_solver once per puzzle. A request is one line:
+//
+//    id [MS] WxH:cells
+//
+//where MS is the deadline of the request in milliseconds from its arrival,
+//the service's default budget if left out. The deadline bounds the time the
+//request waits in the queue plus the rules and the Grid::search() after them;
+//a request that used it up waiting gets one step of the rules. With MS 0
+//the rules run to the end and there is no search. The answer is one line, as
+//BatchSolver writes it:
+//
+//    id status known/cells microseconds board
+//
+//Answers go out as requests finish, so a slow puzzle holds up no other and
+//the id ties an answer to its request. Blank lines and lines starting with
+//'#' get no answer.
+//
+//The workers live as long as the service, so a request pays for neither
+//process startup nor cold threads: each worker keeps its confined() scratch
+//and its logger ring from one request to the next.
+class SolverService {
+public:
+    SolverService(unsigned threads, std::chrono::milliseconds budget);
+    SolverService(SolverService const& other) = delete;
+    SolverService& operator=(SolverService const& other) = delete;
+    SolverService(SolverService&& other) = delete;
+    SolverService& operator=(SolverService&& other) = delete;
+    ~SolverService();
+
+    //Answers the requests from `in` on `out` until `in` ends, and returns
+    //once every answer is out. Returns the number of requests.
+    std::size_t serve(std::istream& in, std::ostream& out);
+
+    //Listens on a Unix domain socket at `path`, replacing any socket file
+    //there. Every connection is a stream of requests as for serve(), answered
+    //on the same connection. Returns after stop().
+    void serve_socket(std::string const& path);
+
+    //Makes serve_socket() return. Requests already queued are still answered.
+    void stop();
+
+private:
+    struct Job {
+        std::string request;
+        std::size_t number = 0;
+        std::chrono::steady_clock::time_point arrival;
+        std::function<void(std::string const&)> answer;
+    };
+
+    //One client of serve_socket(). The socket closes with the last answer.
+    struct Connection;
+
+    //Splits a request into the line BatchSolver::solve() takes and its budget.
+    [[nodiscard]] std::pair<std::string, std::chrono::milliseconds> parse(std::string_view request) const;
+
+    //Queues a request line unless it is blank or a comment.
+    void submit(std::string_view line, std::function<void(std::string const&)> answer);
+    void work();
+    void read(std::shared_ptr<Connection> connection);
+    //Returns once every submitted job is answered.
+    void drain();
+
+    std::chrono::milliseconds m_budget;
+
+    std::mutex m_mutex;
+    std::condition_variable m_work;
+    std::condition_variable m_idle;
+    std::deque<Job> m_jobs;
+    std::size_t m_busy;
+    std::size_t m_requests;
+    bool m_stop;
+    std::vector<std::thread> m_workers;
+
+    //The listening socket of serve_socket(), -1 when there is none, and the
+    //connections it accepted that are still sending requests, each read by a
+    //thread of its own.
+    std::mutex m_socket_mutex;
+    std::condition_variable m_read;
+    int m_listener;
+    bool m_stopping;
+    std::vector<std::shared_ptr<Connection>> m_connections;
+};
@@ -0,0 +1,58 @@
+#include "ThreadPool.hpp"
+
+ThreadPool::ThreadPool(unsigned const threads)
+    : m_mutex{}
+    , m_cv{}
+    , m_jobs{}
+    , m_stop{false}
+    , m_threads{} {
+
+    m_threads.reserve(threads);
+    for(unsigned i = 0; i < threads; i++) {
+        m_threads.emplace_back([this] { work(); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock{m_mutex};
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    for(auto& t : m_threads) {
+        t.join();
+    }
+}
+
+unsigned ThreadPool::size() const noexcept {
+    return static_cast<unsigned>(m_threads.size());
+}
+
+ThreadPool& ThreadPool::shared() {
+    static ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+    return pool;
+}
+
+void ThreadPool::submit(std::function<void()> job) {
+    {
+        std::lock_guard lock{m_mutex};
+        m_jobs.push(std::move(job));
+    }
+    m_cv.notify_one();
+}
+
+void ThreadPool::work() {
+    for(;;) {
+        std::function<void()> job;
+        {
+            std::unique_lock lock{m_mutex};
+            m_cv.wait(lock, [this] { return m_stop || !m_jobs.empty(); });
+            if(m_jobs.empty()) {
+                return;
+            }
+            job = std::move(m_jobs.front());
+            m_jobs.pop();
+        }
+        job();
+    }
+}
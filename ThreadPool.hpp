@@ -0,0 +1,89 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+//A fixed set of worker threads fed from one job queue.
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned threads);
+    ThreadPool(ThreadPool const& other) = delete;
+    ThreadPool& operator=(ThreadPool const& other) = delete;
+    ThreadPool(ThreadPool&& other) = delete;
+    ThreadPool& operator=(ThreadPool&& other) = delete;
+    ~ThreadPool();
+
+    unsigned size() const noexcept;
+
+    //Runs f(worker) on up to `workers` threads, the calling thread being
+    //worker 0, and returns once every one of them is done. f should pull its
+    //work from shared state: the caller drains it itself, so a helper that
+    //starts late finds nothing left to do. The caller still waits for every
+    //helper to run, so a call from inside a job only returns once a worker is
+    //free to take its helpers. Jobs should call it with workers = 1, which
+    //runs f on the caller alone.
+    template <typename F>
+    void run(unsigned workers, F f);
+
+    //Process wide pool with one thread per hardware thread, less the caller.
+    static ThreadPool& shared();
+
+private:
+    void submit(std::function<void()> job);
+    void work();
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::queue<std::function<void()>> m_jobs;
+    bool m_stop;
+    std::vector<std::thread> m_threads;
+};
+
+template <typename F>
+void ThreadPool::run(unsigned workers, F f) {
+    workers = std::clamp(workers, 1u, size() + 1);
+
+    std::mutex done_mutex;
+    std::condition_variable done_cv;
+    unsigned pending = workers - 1;
+    std::exception_ptr error;
+
+    for(unsigned w = 1; w < workers; w++) {
+        submit([&, w] {
+            std::exception_ptr e;
+            try {
+                f(w);
+            } catch(...) {
+                e = std::current_exception();
+            }
+            std::lock_guard lock{done_mutex};
+            if(e && !error) {
+                error = e;
+            }
+            if(--pending == 0) {
+                done_cv.notify_one();
+            }
+        });
+    }
+
+    try {
+        f(0);
+    } catch(...) {
+        std::lock_guard lock{done_mutex};
+        if(!error) {
+            error = std::current_exception();
+        }
+    }
+
+    std::unique_lock lock{done_mutex};
+    done_cv.wait(lock, [&] { return pending == 0; });
+    if(error) {
+        std::rethrow_exception(error);
+    }
+}
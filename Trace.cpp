@@ -0,0 +1,21 @@
+#include "Trace.hpp"
+
+#include <utility>
+
+Trace::Trace(int const width, std::vector<int> start)
+    : m_width{width}
+    , m_start(std::move(start))
+    , m_steps{}
+    , m_changes{}
+    , m_failed{} {
+}
+
+void Trace::change(int const cell, int const value) {
+    m_changes.push_back(Change{cell, value});
+}
+
+void Trace::step(std::string_view const message, int const failed_guesses, std::vector<int> const& failed) {
+    m_failed.insert(m_failed.end(), failed.begin(), failed.end());
+    m_steps.push_back(Step{std::string(message), std::chrono::steady_clock::now(), failed_guesses,
+                           m_changes.size(), m_failed.size()});
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+//The steps of a solve, for Grid::write(). The board is kept once, as it was
+//when the trace started, and after that every step only holds the cells that
+//changed since the step before, plus the cells of its failed guesses. Cells
+//are numbered x + y * width and hold Grid's values: a number, or one of the
+//negative states.
+class Trace {
+public:
+    using time_point = std::chrono::steady_clock::time_point;
+
+    struct Change {
+        int cell;
+        int value;
+    };
+
+    //Step k owns changes()[steps()[k - 1].changes_end, changes_end) and the
+    //same range of failed().
+    struct Step {
+        std::string message;
+        time_point time;
+        int failed_guesses;
+        std::size_t changes_end;
+        std::size_t failed_end;
+    };
+
+    //What replay() shows of the board after a step.
+    class View {
+    public:
+        [[nodiscard]] int value(int cell) const noexcept { return m_board[cell]; }
+        //Whether the step changed the cell.
+        [[nodiscard]] bool changed(int cell) const noexcept { return m_changed[cell] == m_step; }
+        //Whether the cell was one of the step's failed guesses.
+        [[nodiscard]] bool failed(int cell) const noexcept { return m_failed[cell] == m_step; }
+
+    private:
+        friend class Trace;
+        std::vector<int> m_board;
+        std::vector<std::size_t> m_changed;
+        std::vector<std::size_t> m_failed;
+        std::size_t m_step = 0;
+    };
+
+    //An empty trace records nothing.
+    Trace() = default;
+    Trace(int width, std::vector<int> start);
+
+    [[nodiscard]] bool recording() const noexcept { return m_width > 0; }
+    [[nodiscard]] int width() const noexcept { return m_width; }
+
+    //Cell `cell` now holds `value`. The change goes to the next step.
+    void change(int cell, int value);
+
+    //Closes a step with the changes made since the previous one.
+    void step(std::string_view message, int failed_guesses = 0, std::vector<int> const& failed = {});
+
+    [[nodiscard]] std::vector<int> const& start() const noexcept { return m_start; }
+    [[nodiscard]] std::vector<Step> const& steps() const noexcept { return m_steps; }
+    [[nodiscard]] std::vector<Change> const& changes() const noexcept { return m_changes; }
+    [[nodiscard]] std::vector<int> const& failed() const noexcept { return m_failed; }
+
+    //Calls f(step, view) for every step in order. Each step only applies its
+    //own changes to the one board that view shows.
+    template <typename F>
+    void replay(F f) const;
+
+private:
+    int m_width = 0;
+    std::vector<int> m_start;
+    std::vector<Step> m_steps;
+    std::vector<Change> m_changes;
+    std::vector<int> m_failed;
+};
+
+template <typename F>
+void Trace::replay(F f) const {
+    View view;
+    view.m_board = m_start;
+    view.m_changed.assign(m_start.size(), 0);
+    view.m_failed.assign(m_start.size(), 0);
+
+    std::size_t changes = 0;
+    std::size_t failed = 0;
+    for(auto const& step : m_steps) {
+        //Steps are counted from 1 so that the 0 the stamps start with matches none.
+        view.m_step++;
+        for(; changes < step.changes_end; changes++) {
+            view.m_board[m_changes[changes].cell] = m_changes[changes].value;
+            view.m_changed[m_changes[changes].cell] = view.m_step;
+        }
+        for(; failed < step.failed_end; failed++) {
+            view.m_failed[m_failed[failed]] = view.m_step;
+        }
+        f(step, static_cast<View const&>(view));
+    }
+}
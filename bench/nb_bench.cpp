@@ -0,0 +1,223 @@
+//nb_bench times the solver over a corpus of puzzles.
+//
+//    nb_bench [--corpus FILE] [--runs N] [--warmup N] [--threads N] [--filter TEXT] [--budget MS]
+//                [--probing full|local|adaptive]
+//
+//Every puzzle is solved `warmup` times untimed and then `runs` times timed,
+//each time from a freshly parsed Grid, probing guesses as Grid::Probing says.
+//Grid::search() settles what the rules leave open, within `budget`
+//milliseconds of the start if the budget is not 0; by default there is no
+//limit, as every puzzle of the default corpus has a unique solution. The
+//results go to standard output as JSON lines: one object per puzzle with the
+//median and p99 of the whole solve and of every timed phase of Grid (see
+//Grid::Phase) plus the Grid::Stats of the last run, then one summary object.
+//Times are in microseconds. The corpus format is the one of Batch.hpp; the
+//default corpus is bench/corpus.txt.
+
+#include "Batch.hpp"
+#include "Grid.hpp"
+#include "Log.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifndef NB_BENCH_CORPUS
+#define NB_BENCH_CORPUS "bench/corpus.txt"
+#endif
+
+namespace {
+    struct Options {
+        std::string corpus = NB_BENCH_CORPUS;
+        int runs = 5;
+        int warmup = 1;
+        unsigned threads = 1;
+        std::string filter;
+        std::chrono::milliseconds budget{0};
+        Grid::Probing probing = Grid::Probing::FULL;
+    };
+
+    //Nearest rank percentile of the samples, q in (0, 1].
+    double percentile(std::vector<double> samples, double const q) {
+        if(samples.empty()) {
+            return 0.0;
+        }
+        std::sort(samples.begin(), samples.end());
+        auto const rank = static_cast<std::size_t>(std::ceil(q * samples.size()));
+        return samples[std::clamp<std::size_t>(rank, 1, samples.size()) - 1];
+    }
+
+    double microseconds(std::chrono::nanoseconds const t) {
+        return std::chrono::duration<double, std::micro>(t).count();
+    }
+
+    std::string quoted(std::string_view const s) {
+        std::string q = "\"";
+        for(char const c : s) {
+            if(c == '"' || c == '\\') {
+                q += '\\';
+            }
+            q += c;
+        }
+        return q + '"';
+    }
+
+    void write_times(std::ostream& os, std::vector<double> const& samples) {
+        os << "\"median_us\":" << percentile(samples, 0.5)
+           << ",\"p99_us\":" << percentile(samples, 0.99);
+    }
+
+    //Solves one puzzle warmup + runs times and writes its JSON line.
+    //Returns the median time of the whole solve.
+    double bench(std::string_view const name, std::string_view const puzzle, Options const& options) {
+        std::vector<double> totals;
+        std::vector<std::vector<double>> phases(Grid::PHASE_COUNT);
+        Grid::Stats last;
+        std::string_view status;
+        int known = 0;
+        int cells = 0;
+
+        for(int run = 0; run < options.warmup + options.runs; run++) {
+            auto const start = std::chrono::steady_clock::now();
+            Grid g{puzzle};
+            g.set_threads(options.threads);
+            g.set_timing(true);
+            g.set_trace(false);
+            g.set_probing(options.probing);
+
+            Grid::SitRep sitrep = Grid::SitRep::KEEP_GOING;
+            while(sitrep == Grid::SitRep::KEEP_GOING) {
+                sitrep = g.solve(false);
+            }
+            if(sitrep == Grid::SitRep::CANNOT_PROCEED) {
+                sitrep = g.search(options.budget.count() > 0
+                    ? start + options.budget : Grid::steady_clock_tp::max(), false);
+            }
+            auto const finish = std::chrono::steady_clock::now();
+
+            if(run < options.warmup) {
+                continue;
+            }
+            totals.push_back(microseconds(finish - start));
+            for(auto p = 0; p < Grid::PHASE_COUNT; p++) {
+                phases[p].push_back(microseconds(g.stats().phases[p].time));
+            }
+            last = g.stats();
+            status = sitrep == Grid::SitRep::SOLUTION_FOUND ? "solved"
+                : sitrep == Grid::SitRep::CONTRADICTION_FOUND ? "contradiction" : "stuck";
+            known = g.knownElements();
+            cells = static_cast<int>(g.board().size());
+        }
+
+        std::cout << "{\"puzzle\":" << quoted(name)
+                  << ",\"status\":\"" << status << '"'
+                  << ",\"known\":" << known << ",\"cells\":" << cells
+                  << ",\"runs\":" << options.runs << ',';
+        write_times(std::cout, totals);
+        std::cout << ",\"phases\":{";
+        for(auto p = 0; p < Grid::PHASE_COUNT; p++) {
+            std::cout << (p > 0 ? "," : "") << quoted(Grid::phase_name(static_cast<Grid::Phase>(p)))
+                      << ":{";
+            write_times(std::cout, phases[p]);
+            std::cout << '}';
+        }
+        std::cout << "},\"stats\":";
+        last.write_json(std::cout);
+        std::cout << '}' << std::endl;
+
+        return percentile(totals, 0.5);
+    }
+
+    char const* const usage =
+        "usage: nb_bench [--corpus FILE] [--runs N] [--warmup N] [--threads N] [--filter TEXT] [--budget MS]\n"
+        "                [--probing full|local|adaptive]\n";
+
+    bool parse(int const argc, char* argv[], Options& options) {
+        for(int i = 1; i < argc; i += 2) {
+            std::string_view const arg = argv[i];
+            if(i + 1 == argc) {
+                return false;
+            }
+            std::string const value = argv[i + 1];
+
+            if(arg == "--corpus") {
+                options.corpus = value;
+            } else if(arg == "--runs") {
+                options.runs = std::max(1, std::stoi(value));
+            } else if(arg == "--warmup") {
+                options.warmup = std::max(0, std::stoi(value));
+            } else if(arg == "--threads") {
+                options.threads = static_cast<unsigned>(std::max(1, std::stoi(value)));
+            } else if(arg == "--filter") {
+                options.filter = value;
+            } else if(arg == "--budget") {
+                options.budget = std::chrono::milliseconds(std::max(0, std::stoi(value)));
+            } else if(arg == "--probing" && value == "full") {
+                options.probing = Grid::Probing::FULL;
+            } else if(arg == "--probing" && value == "local") {
+                options.probing = Grid::Probing::LOCAL_FIRST;
+            } else if(arg == "--probing" && value == "adaptive") {
+                options.probing = Grid::Probing::ADAPTIVE;
+            } else {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    try {
+        if(!parse(argc, argv, options)) {
+            std::cerr << usage;
+            return EXIT_FAILURE;
+        }
+
+        std::ifstream in{options.corpus};
+        if(!in) {
+            std::cerr << "cannot open " << options.corpus << std::endl;
+            return EXIT_FAILURE;
+        }
+        //Standard output carries the results.
+        Logger::lg.echo(false);
+        std::cout << std::fixed << std::setprecision(1);
+
+        int puzzles = 0;
+        int failures = 0;
+        double total = 0.0;
+        std::string line;
+        while(std::getline(in, line)) {
+            if(!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            if(!BatchSolver::is_puzzle(line) || line.find(options.filter) == std::string::npos) {
+                continue;
+            }
+            auto const [ name, puzzle ] = BatchSolver::split(line);
+            puzzles++;
+            try {
+                total += bench(name, puzzle, options);
+            } catch(std::exception const& e) {
+                failures++;
+                std::cout << "{\"puzzle\":" << quoted(name) << ",\"error\":" << quoted(e.what()) << '}' << std::endl;
+            }
+        }
+
+        std::cout << "{\"summary\":{\"puzzles\":" << puzzles << ",\"failures\":" << failures
+                  << ",\"runs\":" << options.runs << ",\"warmup\":" << options.warmup
+                  << ",\"threads\":" << options.threads << ",\"median_sum_us\":" << total << "}}" << std::endl;
+
+    } catch(std::exception const& e) {
+        std::cerr << "exception caught " << e.what();
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
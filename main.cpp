@@ -1,13 +1,147 @@
 #include <iostream>
 #include <array>
+#include <chrono>
 #include <fstream>
+#include <string_view>
+#include <thread>
 #include "Log.hpp"
 #include "Grid.hpp"
+#include "Batch.hpp"
+#include "Service.hpp"
 
 using namespace std;
 
-int main()
+namespace {
+	char const* const usage =
+		"usage: nb_solver [--batch <corpus|-> [--order input|completion] [--threads N] [--stats FILE] [--budget MS] [--count N]]\n"
+		"       nb_solver --serve <socket|-> [--threads N] [--budget MS]\n";
+
+	//Solves a corpus, see Batch.hpp. "-" reads the corpus from stdin.
+	int run_batch(int const argc, char* argv[]) {
+		string_view corpus;
+		string_view stats_file;
+		chrono::milliseconds budget{10000};
+		int count = 0;
+		BatchSolver::Order order = BatchSolver::Order::INPUT;
+		unsigned threads = std::thread::hardware_concurrency();
+
+		for (int i = 1; i < argc; i++) {
+			string_view const arg = argv[i];
+			string_view const value = i + 1 < argc ? argv[i + 1] : "";
+
+			if (arg == "--batch" && !value.empty()) {
+				corpus = value;
+			}
+			else if (arg == "--order" && (value == "input" || value == "completion")) {
+				order = value == "input" ? BatchSolver::Order::INPUT : BatchSolver::Order::COMPLETION;
+			}
+			else if (arg == "--threads" && !value.empty()) {
+				threads = static_cast<unsigned>(stoul(string(value)));
+			}
+			else if (arg == "--stats" && !value.empty()) {
+				stats_file = value;
+			}
+			else if (arg == "--budget" && !value.empty()) {
+				budget = chrono::milliseconds(stoll(string(value)));
+			}
+			else if (arg == "--count" && !value.empty()) {
+				count = stoi(string(value));
+			}
+			else {
+				cerr << usage;
+				return EXIT_FAILURE;
+			}
+			i++;
+		}
+
+		if (corpus.empty()) {
+			cerr << usage;
+			return EXIT_FAILURE;
+		}
+
+		//Standard output carries the results.
+		Logger::lg.echo(false);
+
+		BatchSolver const solver(order, threads, budget, count);
+		Grid::Stats stats;
+		if (corpus == "-") {
+			solver.run(cin, cout, &stats);
+		}
+		else {
+			ifstream in{string(corpus)};
+			if (!in) {
+				cerr << "cannot open " << corpus << endl;
+				return EXIT_FAILURE;
+			}
+			solver.run(in, cout, &stats);
+		}
+
+		if (!stats_file.empty()) {
+			ofstream f{string(stats_file)};
+			stats.write_json(f);
+			f << endl;
+		}
+		return EXIT_SUCCESS;
+	}
+
+	//Answers puzzles as they arrive, see Service.hpp. "-" serves stdin until
+	//it ends, anything else is the path of a Unix domain socket.
+	int run_serve(int const argc, char* argv[]) {
+		string_view endpoint;
+		chrono::milliseconds budget{10000};
+		unsigned threads = std::thread::hardware_concurrency();
+
+		for (int i = 1; i < argc; i++) {
+			string_view const arg = argv[i];
+			string_view const value = i + 1 < argc ? argv[i + 1] : "";
+
+			if (arg == "--serve" && !value.empty()) {
+				endpoint = value;
+			}
+			else if (arg == "--threads" && !value.empty()) {
+				threads = static_cast<unsigned>(stoul(string(value)));
+			}
+			else if (arg == "--budget" && !value.empty()) {
+				budget = chrono::milliseconds(stoll(string(value)));
+			}
+			else {
+				cerr << usage;
+				return EXIT_FAILURE;
+			}
+			i++;
+		}
+
+		if (endpoint.empty()) {
+			cerr << usage;
+			return EXIT_FAILURE;
+		}
+
+		//Standard output carries the answers.
+		Logger::lg.echo(false);
+
+		SolverService service(threads, budget);
+		if (endpoint == "-") {
+			service.serve(cin, cout);
+		}
+		else {
+			service.serve_socket(string(endpoint));
+		}
+		return EXIT_SUCCESS;
+	}
+}
+
+int main(int argc, char* argv[])
 {
+	if (argc > 1) {
+		try {
+			return string_view(argv[1]) == "--serve" ? run_serve(argc, argv) : run_batch(argc, argv);
+		}
+		catch (exception const& e) {
+			cerr << "exception caught " << e.what();
+			return EXIT_FAILURE;
+		}
+	}
+
 	struct Puzzle {
 		const char* name;
 		int w;
@@ -69,8 +203,15 @@ int main()
 		for (auto const& puzzle : puzzles) {
 			auto const start = std::chrono::steady_clock::now();
 			Grid g(puzzle.w, puzzle.h, puzzle.s);
-			Logger::lg.msg("[INFO] we are working on it...");
-			while(g.solve() == Grid::SitRep::KEEP_GOING) { }
+			Logger::lg.info("we are working on it...");
+			Grid::SitRep sitrep = Grid::SitRep::KEEP_GOING;
+			while(sitrep == Grid::SitRep::KEEP_GOING) {
+				sitrep = g.solve();
+			}
+			if (sitrep == Grid::SitRep::CANNOT_PROCEED) {
+				using namespace std::chrono_literals;
+				g.search(std::chrono::steady_clock::now() + 60s);
+			}
 			
 
 			auto const finish = std::chrono::steady_clock::now();
@@ -78,8 +219,16 @@ int main()
 			ofstream f(puzzle.name + string(".html"));
 			g.write(f, start, finish);
 
+			ofstream trace_file(puzzle.name + string(".trace.json"));
+			g.write_trace_json(trace_file);
+			trace_file << endl;
+
+			ofstream stats_file(puzzle.name + string(".stats.json"));
+			g.stats().write_json(stats_file);
+			stats_file << endl;
+
 			cout << puzzle.name << std::endl;
-			Logger::lg.msg(" Puzzle took " + format_time(start, finish));
+			Logger::lg.info("Puzzle took ", format_time(start, finish));
 
 			const int k = g.knownElements();
 			const int cells = puzzle.w * puzzle.h;